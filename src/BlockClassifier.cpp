@@ -0,0 +1,201 @@
+#include <cstring>
+#include "BlockClassifier.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CSV_X86_KERNELS
+#endif
+
+using namespace std;
+
+namespace
+{
+  typedef void (*Kernel)(const char* p, BlockClassifier::BlockMasks& masks);
+
+  void classify_scalar(const char* p, BlockClassifier::BlockMasks& masks)
+  {
+    uint64_t newline = 0, comma = 0, quote = 0;
+
+    for (unsigned i = 0; i < BlockClassifier::s_blockSize; ++i)
+    {
+      const uint64_t bit = uint64_t(1) << i;
+      newline |= p[i] == '\n' ? bit : 0;
+      comma |= p[i] == ',' ? bit : 0;
+      quote |= p[i] == '"' ? bit : 0;
+    }
+
+    masks.newline = newline;
+    masks.comma = comma;
+    masks.quote = quote;
+  }
+
+#if defined(CSV_X86_KERNELS)
+  __attribute__((target("sse2")))
+  void classify_sse2(const char* p, BlockClassifier::BlockMasks& masks)
+  {
+    const __m128i newlines = _mm_set1_epi8('\n');
+    const __m128i commas = _mm_set1_epi8(',');
+    const __m128i quotes = _mm_set1_epi8('"');
+    uint64_t newline = 0, comma = 0, quote = 0;
+
+    for (unsigned i = 0; i < BlockClassifier::s_blockSize; i += 16)
+    {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+      newline |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newlines)))) << i;
+      comma |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, commas)))) << i;
+      quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, quotes)))) << i;
+    }
+
+    masks.newline = newline;
+    masks.comma = comma;
+    masks.quote = quote;
+  }
+
+  __attribute__((target("avx2")))
+  inline uint64_t mask_avx2(__m256i lo, __m256i hi, char c)
+  {
+    const __m256i chars = _mm256_set1_epi8(c);
+    const uint32_t l = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, chars));
+    const uint32_t h = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, chars));
+    return uint64_t(l) | (uint64_t(h) << 32);
+  }
+
+  __attribute__((target("avx2")))
+  void classify_avx2(const char* p, BlockClassifier::BlockMasks& masks)
+  {
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+
+    masks.newline = mask_avx2(lo, hi, '\n');
+    masks.comma = mask_avx2(lo, hi, ',');
+    masks.quote = mask_avx2(lo, hi, '"');
+  }
+#endif
+
+  Kernel get_kernel(BlockClassifier::E_KERNEL kernel)
+  {
+    switch (kernel)
+    {
+#if defined(CSV_X86_KERNELS)
+      case BlockClassifier::E_AVX2:
+        return classify_avx2;
+      case BlockClassifier::E_SSE2:
+        return classify_sse2;
+#endif
+      default:
+        return classify_scalar;
+    }
+  }
+
+  BlockClassifier::E_KERNEL select_kernel()
+  {
+    if (BlockClassifier::isSupported(BlockClassifier::E_AVX2))
+    {
+      return BlockClassifier::E_AVX2;
+    }
+
+    if (BlockClassifier::isSupported(BlockClassifier::E_SSE2))
+    {
+      return BlockClassifier::E_SSE2;
+    }
+
+    return BlockClassifier::E_SCALAR;
+  }
+
+  const BlockClassifier::E_KERNEL s_kernelType = select_kernel();
+  const Kernel s_kernel = get_kernel(s_kernelType);
+}
+
+BlockClassifier::BlockClassifier(string_view data)
+{
+  reset(data);
+}
+
+void BlockClassifier::reset(string_view data)
+{
+  m_data = data;
+  m_blockStart = string_view::npos;
+}
+
+size_t BlockClassifier::find(size_t pos, uint64_t BlockMasks::* pMask)
+{
+  const size_t size = m_data.size();
+
+  if (pos >= size)
+  {
+    return size;
+  }
+
+  size_t blockStart = pos & ~(s_blockSize - 1);
+
+  if (blockStart != m_blockStart)
+  {
+    load_block(blockStart);
+  }
+
+  // Discard the characters preceding pos
+  uint64_t mask = (m_masks.*pMask) & (~uint64_t(0) << (pos - blockStart));
+
+  while (mask == 0)
+  {
+    blockStart += s_blockSize;
+
+    if (blockStart >= size)
+    {
+      return size;
+    }
+
+    load_block(blockStart);
+    mask = m_masks.*pMask;
+  }
+
+  size_t ret = blockStart + __builtin_ctzll(mask);
+  return ret;
+}
+
+void BlockClassifier::load_block(size_t blockStart)
+{
+  m_blockStart = blockStart;
+  const size_t remainder = m_data.size() - blockStart;
+
+  if (remainder >= s_blockSize)
+  {
+    s_kernel(m_data.data() + blockStart, m_masks);
+  }
+  else
+  {
+    // Pad the last partial block, zero bytes are not structural characters
+    char buf[s_blockSize] = {};
+    ::memcpy(buf, m_data.data() + blockStart, remainder);
+    s_kernel(buf, m_masks);
+  }
+}
+
+void BlockClassifier::classify(const char* pBlock, BlockMasks& masks, E_KERNEL kernel)
+{
+  get_kernel(kernel)(pBlock, masks);
+}
+
+bool BlockClassifier::isSupported(E_KERNEL kernel)
+{
+#if defined(CSV_X86_KERNELS)
+  __builtin_cpu_init();
+
+  switch (kernel)
+  {
+    case E_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case E_SSE2:
+      return __builtin_cpu_supports("sse2");
+    default:
+      return true;
+  }
+#else
+  return kernel == E_SCALAR;
+#endif
+}
+
+BlockClassifier::E_KERNEL BlockClassifier::getKernel()
+{
+  return s_kernelType;
+}
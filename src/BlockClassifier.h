@@ -0,0 +1,52 @@
+/*
+  BlockClassifier locates the structural characters of CSV data: newlines,
+  commas and quotes. The data is classified 64 bytes at a time by a vector
+  kernel that yields one bitmask per character, so that the next character
+  of interest can be found by bitmask arithmetic instead of examining the
+  data byte by byte. The kernel is selected at run-time: AVX2 if supported
+  by the CPU, otherwise SSE2 (always available on x86-64) or portable code.
+*/
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+class BlockClassifier
+{
+public:
+  static const std::size_t s_blockSize = 64;
+
+  struct BlockMasks
+  {
+    // Bit N is set if byte N of the block is the respective character
+    uint64_t newline;
+    uint64_t comma;
+    uint64_t quote;
+  };
+
+  typedef enum { E_SCALAR, E_SSE2, E_AVX2 } E_KERNEL;
+
+  explicit BlockClassifier(std::string_view data = std::string_view());
+
+  // Start classifying another piece of data
+  void reset(std::string_view data);
+
+  // The functions return the position of the next respective character
+  // found at or after pos, or the size of the data if there is none.
+  std::size_t findNewline(std::size_t pos) { return find(pos, &BlockMasks::newline); }
+  std::size_t findComma(std::size_t pos) { return find(pos, &BlockMasks::comma); }
+  std::size_t findQuote(std::size_t pos) { return find(pos, &BlockMasks::quote); }
+
+  // Classifies one block of s_blockSize bytes using the given kernel
+  static void classify(const char* pBlock, BlockMasks& masks, E_KERNEL kernel);
+  static bool isSupported(E_KERNEL kernel);
+  static E_KERNEL getKernel();
+
+private:
+  std::size_t find(std::size_t pos, uint64_t BlockMasks::* pMask);
+  void load_block(std::size_t blockStart);
+
+  std::string_view m_data;
+  std::size_t m_blockStart;
+  BlockMasks m_masks;
+};
@@ -1,27 +1,70 @@
 #include <cassert>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
 #include <thread>
-#include <fstream>
+#include <iostream>
+#include <condition_variable>
+#include <unistd.h>
 #include "CsvFile.h"
 #include "CsvRowReader.h"
-#include "iterator.h"
+#include "RingBuffer.h"
 #include "utility.h"
 #include "main.h"
+#include "config/RuntimeConfig.h"
+#include "io/Compression.h"
+#include "handlers/CsvScannerGoogle.h"
+#include "handlers/CsvProcessorGoogle.h"
 
 using namespace std;
 
+namespace
+{
+  // Inserts the suffix before the file extension, e.g. out.csv -> out-reject.csv
+  string insert_suffix(const string& path, const char* suffix)
+  {
+    string ret = path;
+    size_t ind = ret.find_last_of(".'");
+    ret.insert(ind, suffix);
+    return ret;
+  }
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+const vector<RejectWriter::Reason>
+CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::s_rejectReasons{
+  // E_SCAN: the rows rejected by the scanner
+  { "Invalid data", "", false },
+  // E_PROCESSING
+  { "Processing failure", "Processing failure for row ", true },
+  // E_MALFORMED: the rows violating the CSV quoting rules
+  { "Incorrectly quoted CSV field", "Incorrectly quoted CSV field in row ", true }
+};
+
 template <
-  size_t DataFieldCount, 
+  size_t DataFieldCount,
   size_t ProcessorInputFieldCount,
-  size_t ProcessorOutputFieldCount>
-CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>::CsvFile(
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::CsvFile(
   const string& inFile,
   const string& outFile,
   DataFields&& indices,
   ProcessorPtr&& pProcessor,
   ScannerPtr&& pScanner
   ) :
-  m_indices(move(indices)), m_pProcessor(move(pProcessor)), m_pScanner(move(pScanner)),
-  m_countProcessed(0), m_countRejected(0), m_countRejectedIndex(0)
+  m_indices(move(indices)),
+  m_rejectWriter(s_rejectReasons,
+    RuntimeConfig::GetInstance().getRejectLimit(), RuntimeConfig::GetInstance().getRejectSampling()),
+  m_pProcessor(move(pProcessor)), m_pScanner(move(pScanner)),
+  m_countProcessed(0), m_countRejected(0), m_countMalformed(0), m_countRejectedIndex(0),
+  m_inputOffset(0), m_bInputTerminated(true)
 {
   bool bValid = static_cast<bool>(m_pProcessor) &&
     !inFile.empty() && !outFile.empty() && indices.size();
@@ -32,19 +75,70 @@ CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>::CsvF
     utility::throw_exception<invalid_argument>("invalid CsvFile argument(s)");
   }
 
-  m_inStream.open(inFile.c_str(), ios::binary);
-  m_outStream.open(outFile.c_str(), ios::binary | ios::trunc);
+  m_pInSource = InputSource::create(inFile, RuntimeConfig::GetInstance().getMapInputFiles());
+  m_threadCount = RuntimeConfig::GetInstance().getProcessingThreads();
+  m_bPipeline = RuntimeConfig::GetInstance().getPipelineProcessing();
+  m_bIncremental = RuntimeConfig::GetInstance().getIncrementalProcessing();
+
+  if (m_threadCount == 0)
+  {
+    m_threadCount = max(thread::hardware_concurrency(), 1u);
+  }
+
+  // The compressed output file gets the extension of the compression
+  const string& compressionName = RuntimeConfig::GetInstance().getOutputCompression();
+  auto compression = Compression::E_NONE;
+  string extension;
+
+  if (compressionName == "gzip")
+  {
+    compression = Compression::E_GZIP;
+    extension = ".gz";
+  }
+  else if (compressionName == "zstd")
+  {
+    compression = Compression::E_ZSTD;
+    extension = ".zst";
+  }
+  else if (!compressionName.empty())
+  {
+    utility::throw_exception<invalid_argument>("unknown output compression");
+  }
+
+  if (!Compression::isSupported(compression))
+  {
+    utility::throw_exception<runtime_error>("output compression not supported by the build");
+  }
+
+  unsigned compressionThreads = RuntimeConfig::GetInstance().getCompressionThreads();
+
+  if (compressionThreads == 0)
+  {
+    compressionThreads = max(thread::hardware_concurrency(), 1u);
+  }
+
+  // An incremental run writes the appended rows to the append file
+  string dataFile = outFile;
 
-  string rejectFile = outFile;
-  const char* insertion = "-reject";
-  size_t ind = rejectFile.find_last_of(".'");
-  rejectFile.insert(ind, insertion);
-  m_rejectStream.open(rejectFile.c_str(), ios::binary | ios::trunc);
+  if (m_bIncremental)
+  {
+    m_checkpointPath = outFile + ".checkpoint";
+    const string appendFile = insert_suffix(outFile, "-append");
 
-  locale loc("C.UTF-8");
-  m_inStream.imbue(loc);
-  m_outStream.imbue(loc);
-  m_rejectStream.imbue(loc);
+    if (resume_checkpoint(inFile))
+    {
+      dataFile = appendFile;
+    }
+    else
+    {
+      // Remove the output of the last incremental run, it is superseded
+      ::unlink((appendFile + extension).c_str());
+      ::unlink(insert_suffix(appendFile, "-reject").c_str());
+    }
+  }
+
+  m_outWriter.open(dataFile + extension, compression, compressionThreads);
+  m_rejectWriter.open(insert_suffix(dataFile, "-reject"));
 
   if (!check_streams())
   {
@@ -56,8 +150,10 @@ CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>::CsvF
 template <
   size_t DataFieldCount,
   size_t ProcessorInputFieldCount,
-  size_t ProcessorOutputFieldCount>
-CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>::~CsvFile()
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::~CsvFile()
 {
   if (!check_streams())
   {
@@ -69,12 +165,14 @@ CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>::~Csv
 template <
   size_t DataFieldCount,
   size_t ProcessorInputFieldCount,
-  size_t ProcessorOutputFieldCount>
-bool CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>::check_streams() const
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+bool CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::check_streams() const
 {
-  bool ret = m_inStream.is_open() && !m_inStream.bad() &&
-    m_outStream.is_open() && !m_outStream.bad() &&
-    m_rejectStream.is_open() && !m_rejectStream.bad();
+  bool ret = m_pInSource && m_pInSource->is_open() && !m_pInSource->bad() &&
+    m_outWriter.is_open() && !m_outWriter.bad() &&
+    m_rejectWriter.is_open() && !m_rejectWriter.bad();
 
   return ret;
 }
@@ -82,153 +180,801 @@ bool CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>:
 template <
   size_t DataFieldCount,
   size_t ProcessorInputFieldCount,
-  size_t ProcessorOutputFieldCount>
-ExitCode CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>::process()
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+bool CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::resume_checkpoint(const string& inFile)
 {
-  // Create a row reader
-  array<unsigned, DataFieldCount> arr;
+  Checkpoint checkpoint;
+  bool bMatch = checkpoint.load(m_checkpointPath) && checkpoint.fingerprint == fingerprint();
+
+  // A run that fails after this point must not leave a checkpoint behind
+  ::unlink(m_checkpointPath.c_str());
+
+  // The checkpoint prefix consists of whole lines, read it in blocks that
+  // end exactly at the checkpoint offset unless the input has changed
+  size_t remaining = checkpoint.offset;
+  string_view block;
 
-  for (unsigned i = 0; i < m_indices.size(); ++i)
+  while (bMatch && remaining > 0)
   {
-    arr[i] = get<0>(m_indices[i]);
+    bMatch = m_pInSource->getBlock(min(remaining, size_t(s_chunkSize)), block) && block.size() <= remaining;
+
+    if (bMatch)
+    {
+      m_inputHasher.update(block);
+      remaining -= block.size();
+    }
   }
 
-  CsvRowReader<DataFieldCount> rowReader(arr);
+  if (!bMatch || m_inputHasher.value() != checkpoint.prefixHash)
+  {
+    cout << APP_TITLE" - no matching checkpoint, processing all data rows" << endl;
+    m_inputHasher = utility::Hasher();
+    m_pInSource = InputSource::create(inFile, RuntimeConfig::GetInstance().getMapInputFiles());
+    return false;
+  }
 
-  // Loop through the CSV file
-  auto incrementRowCount = [this]() { ++m_countProcessed; };
+  cout << APP_TITLE" - resuming after " << checkpoint.rows << " data rows processed by the last run" << endl;
+  m_checkpoint = checkpoint;
+  m_inputOffset = checkpoint.offset;
+  return true;
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+void CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::save_checkpoint()
+{
+  // The next run could not tell whether the last row has been extended
+  if (!m_bInputTerminated)
+  {
+    cerr << APP_TITLE" - the last data row is not terminated, checkpoint not saved" << endl;
+    return;
+  }
+
+  Checkpoint checkpoint;
+  checkpoint.offset = m_inputOffset;
+  checkpoint.prefixHash = m_inputHasher.value();
+  checkpoint.fingerprint = fingerprint();
+  checkpoint.rows = getProcessedCount();
+  checkpoint.rejectedRows = getRejectedCount();
+
+  if (!checkpoint.save(m_checkpointPath))
+  {
+    utility::throw_exception<runtime_error>("failed to save checkpoint");
+  }
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+uint64_t CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::fingerprint() const
+{
+  utility::Hasher hasher;
+  hasher.update(m_pProcessor->getFingerprint());
+  hasher.update(m_pScanner->getFingerprint());
+
+  for (const auto& fieldIndex : m_indices)
+  {
+    hasher.update(get<0>(fieldIndex));
+    hasher.update(get<1>(fieldIndex));
+  }
+
+  return hasher.value();
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+ExitCode CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::process()
+{
   cout << APP_TITLE" - processing data" << endl;
 
-  while (g_SIGINT == 0 && m_inStream >> rowReader)
+  if (m_threadCount > 1 && m_bPipeline)
+  {
+    process_pipeline(m_threadCount);
+  }
+  else if (m_threadCount > 1)
+  {
+    process_parallel(m_threadCount);
+  }
+  else
+  {
+    process_serial();
+  }
+
+  m_outWriter.flush();
+  m_rejectWriter.flush();
+
+  if (!check_streams())
   {
-    utility::ScopedAction sa(incrementRowCount);
+    utility::throw_exception<runtime_error>("I/O error during data processing");
+  }
 
-    // Perform record scan
-    using namespace std::placeholders;
-    function<const wstring&(unsigned)> callback = bind(&CsvRowReader<DataFieldCount>::operator[], &rowReader, _1);
-    auto scanResult = m_pScanner->scan(callback);
+  if (m_run.length > 0)
+  {
+    m_runs.add(m_run.length);
+    m_run.length = 0;
+  }
 
-    if (scanResult != CsvScanner::E_ACCEPT)
+  ExitCode ret = ExitCode::E_SUCCESS;
+
+  if (g_SIGINT)
+  {
+    cerr << APP_TITLE" - data processing interrupted" << endl;
+    cerr << APP_TITLE" - terminating on signal, leaving incomplete output files" << endl;
+    ret = ExitCode::E_SIGINT;
+  }
+  else
+  {
+    cout << APP_TITLE" - data processing finished" << endl;
+    cout << APP_TITLE" - processed " << m_countProcessed << " data rows" << endl;
+
+    if (m_countRejected)
+    {
+      cout << APP_TITLE" - rejected " << m_countRejected << " data rows due to index processing failure" << endl;
+    }
+
+    if (m_countMalformed)
+    {
+      cout << APP_TITLE" - rejected " << m_countMalformed << " incorrectly quoted data rows" << endl;
+    }
+
+    if (const unsigned runCount = m_runs.count(); runCount > 0)
+    {
+      const auto& counts = m_runs.counts;
+      cout << APP_TITLE" - " << m_runs.rows << " data rows formed " << runCount <<
+        " runs of the same key, average run length " << m_runs.rows / runCount <<
+        " (1: " << counts[0] << ", 2-9: " << counts[1] << ", 10-99: " << counts[2] <<
+        ", 100-999: " << counts[3] << ", 1000+: " << counts[4] << ")" << endl;
+    }
+  }
+  
+  m_countRejected += m_countMalformed + m_pScanner->getRejectedCount();
+  m_countRejectedIndex = m_pProcessor->getRejectedCount();
+
+  if (m_bIncremental && ret == ExitCode::E_SUCCESS)
+  {
+    save_checkpoint();
+  }
+  
+  return ret;
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+bool CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::read_chunk(Chunk& chunk)
+{
+  string_view block;
+
+  if (!m_pInSource->getBlock(s_chunkSize, block))
+  {
+    return false;
+  }
+
+  if (m_pInSource->is_stable())
+  {
+    chunk.data = block;
+  }
+  else
+  {
+    chunk.storage.assign(block);
+    chunk.data = chunk.storage;
+  }
+
+  if (m_bIncremental)
+  {
+    m_inputHasher.update(block);
+    m_inputOffset += block.size();
+    m_bInputTerminated = block.back() == '\n';
+  }
+
+  return true;
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+void CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::process_chunk(Chunk& chunk, Scanner& scanner) const noexcept
+{
+  chunk.output.clear();
+  chunk.rejects.clear();
+  chunk.countProcessed = 0;
+  chunk.countRejected = 0;
+  chunk.countMalformed = 0;
+  chunk.head.length = 0;
+  chunk.tail.length = 0;
+  chunk.runs = RunStats();
+  chunk.pException = nullptr;
+  chunk.arena.reset();
+
+  // The current run along with its processing result or failure
+  Run run;
+  typename Processor::Result runResult;
+  string_view runError;
+
+  auto endRun = [&chunk, &run]() {
+    if (chunk.head.length == 0)
+    {
+      swap(chunk.head, run);
+    }
+    else
+    {
+      chunk.runs.add(run.length);
+    }
+  };
+
+  try
+  {
+    // Create a row reader
+    array<unsigned, DataFieldCount> arr;
+
+    for (unsigned i = 0; i < m_indices.size(); ++i)
     {
-      if (scanResult == CsvScanner::E_REJECT)
+      arr[i] = get<0>(m_indices[i]);
+    }
+
+    CsvRowReader<DataFieldCount> rowReader(arr);
+    RowBatch<DataFieldCount> batch;
+    MemoryInputSource source(chunk.data);
+
+    // Loop through the batches of rows of the chunk
+    while (g_SIGINT == 0 && rowReader.readBatch(source, batch) > 0)
+    {
+      // Perform record scan of the whole batch
+      const auto scanResult = scanner.scanBatch(batch);
+
+      for (size_t i = 0; i < batch.size(); ++i, ++chunk.countProcessed)
       {
-        const auto& row = rowReader.getReadonlyRow();
-        copy(row.cbegin(), row.cend(), ostream_custom_iterator<wstring>(m_rejectStream, L","));
-        m_rejectStream << L'\n';
+        const batch::Mask bit = batch::Mask(1) << i;
+
+        if ((scanResult.accept & bit) == 0)
+        {
+          if (scanResult.reject & bit)
+          {
+            chunk.rejects.addFields(E_SCAN, chunk.countProcessed, batch.getFields(i));
+          }
+          else if ((batch.validRows() & bit) == 0)
+          {
+            ++chunk.countMalformed;
+            chunk.rejects.add(E_MALFORMED, chunk.countProcessed, batch.getRow(i));
+          }
+
+          continue;
+        }
+
+        // Loop through the CSV fields
+        bool bRejected = false;
+
+        for (const auto& fieldIndex : m_indices)
+        {
+          const auto fieldContent = batch.field(get<0>(fieldIndex), i);
+
+          if (!get<1>(fieldIndex))
+          {
+            chunk.output.appendField(fieldContent);
+            continue;
+          }
+
+          if (run.length == 0 || fieldContent != run.key)
+          {
+            if (run.length > 0)
+            {
+              endRun();
+            }
+
+            run.key = fieldContent;
+            run.length = 0;
+            runResult = performFieldProcessing(fieldContent);
+
+            if (!runResult)
+            {
+              runError = Processor::describeError(runResult.error(), fieldContent, chunk.arena);
+            }
+          }
+
+          ++run.length;
+
+          if (!runResult)
+          {
+            // Stops current row processing
+            bRejected = true;
+            ++chunk.countRejected;
+            chunk.output.discardRow();
+            chunk.rejects.add(E_PROCESSING, chunk.countProcessed, runError);
+            break;
+          }
+
+          chunk.output.appendField(*runResult);
+        }
+
+        if (!bRejected)
+        {
+          chunk.output.endRow();
+        }
       }
-      
-      continue;
+
+      if (chunk.countProcessed % s_yieldFrequency < batch.size())
+      {
+        this_thread::yield();
+      }
+    }
+
+    // The last run becomes the tail unless it is the only one
+    if (run.length > 0)
+    {
+      swap(chunk.head.length == 0 ? chunk.head : chunk.tail, run);
     }
+  }
+  catch (...)
+  {
+    // Unexpected failure, e.g. out of memory. The rows preceding the failed
+    // one are committed, then the exception is rethrown by the thread that
+    // commits the chunk
+    chunk.pException = current_exception();
+  }
+}
 
-    // Loop through the CSV fields
-    unsigned i = 0;
-    bool exceptionCaught = false;
-    wstringstream wsRow;
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+void CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::commit_chunk(Chunk& chunk)
+{
+  m_outWriter.write(chunk.output.data());
+
+  // The rows are numbered from the start of the input file
+  m_rejectWriter.submit(chunk.rejects, m_checkpoint.rows + m_countProcessed);
 
-    for (const auto& fieldIndex : m_indices)
+  m_countProcessed += chunk.countProcessed;
+  m_countRejected += chunk.countRejected;
+  m_countMalformed += chunk.countMalformed;
+  commit_runs(chunk);
+
+  if (!check_streams())
+  {
+    utility::throw_exception<runtime_error>("I/O error during data processing");
+  }
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+void CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::commit_runs(const Chunk& chunk)
+{
+  if (chunk.head.length == 0)
+  {
+    return;
+  }
+
+  // The head of the chunk continues the last run of the preceding chunks
+  if (m_run.length > 0 && chunk.head.key == m_run.key)
+  {
+    m_run.length += chunk.head.length;
+  }
+  else
+  {
+    if (m_run.length > 0)
+    {
+      m_runs.add(m_run.length);
+    }
+
+    m_run = chunk.head;
+  }
+
+  if (chunk.tail.length > 0)
+  {
+    m_runs.add(m_run.length);
+    m_runs.merge(chunk.runs);
+    m_run = chunk.tail;
+  }
+
+  // The chunk data is about to be reused
+  if (m_run.key.data() != m_runKey.data())
+  {
+    m_runKey.assign(m_run.key);
+    m_run.key = m_runKey;
+  }
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+void CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::process_serial()
+{
+  Chunk chunk;
+
+  while (g_SIGINT == 0 && read_chunk(chunk))
+  {
+    process_chunk(chunk, *m_pScanner);
+    commit_chunk(chunk);
+
+    if (chunk.pException)
+    {
+      rethrow_exception(chunk.pException);
+    }
+  }
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+void CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::process_parallel(unsigned workerCount)
+{
+  // The main thread reads the chunks and commits them in input order. Each
+  // chunk is identified by a sequence number and occupies a slot until it is
+  // committed. The count of slots limits the memory used by the chunks.
+  const size_t slotCount = workerCount * s_chunksPerWorker;
+  vector<Chunk> slots(slotCount);
+  vector<bool> processed(slotCount, false);
+  size_t readSeq = 0;     // count of chunks read
+  size_t takeSeq = 0;     // count of chunks taken by workers
+  size_t commitSeq = 0;   // count of chunks committed
+  bool bInputDone = false;
+  mutex mtx;
+  condition_variable cvWorker;
+  condition_variable cvCommit;
+
+  auto worker = [&]()
+  {
+    // The scanners keep counts, each worker uses its own scanner
+    unique_ptr<Scanner> pScanner = clone_scanner();
+    unique_lock<mutex> lock(mtx);
+
+    while (true)
     {
-      try 
+      cvWorker.wait(lock, [&]() { return takeSeq < readSeq || bInputDone; });
+
+      if (takeSeq == readSeq)
       {
-        const auto& fieldContent = rowReader[get<0>(fieldIndex)];
-        // extend lifetime of rvalue returned by performFieldProcessing()
-        const auto& processingResult = get<1>(fieldIndex)? performFieldProcessing(fieldContent): fieldContent;
+        break;
+      }
+
+      const size_t slot = takeSeq++ % slotCount;
+      lock.unlock();
+      process_chunk(slots[slot], *pScanner);
+      lock.lock();
+      processed[slot] = true;
+      cvCommit.notify_one();
+    }
+
+    m_pScanner->addCounts(*pScanner);
+  };
+
+  vector<thread> workers;
+
+  for (unsigned i = 0; i < workerCount; ++i)
+  {
+    workers.emplace_back(worker);
+  }
+
+  exception_ptr pException;
+  unique_lock<mutex> lock(mtx);
 
-        wsRow << processingResult;
+  try
+  {
+    while (true)
+    {
+      const size_t commitSlot = commitSeq % slotCount;
+
+      if (commitSeq < readSeq && processed[commitSlot])
+      {
+        Chunk& chunk = slots[commitSlot];
+        lock.unlock();
+        commit_chunk(chunk);
+        lock.lock();
+        processed[commitSlot] = false;
+        ++commitSeq;
+
+        if (chunk.pException)
+        {
+          rethrow_exception(chunk.pException);
+        }
       }
-      catch (const exception& ex)
+      else if (!bInputDone && readSeq - commitSeq < slotCount)
       {
-        exceptionCaught = true;
+        // The slot is not used by the workers until readSeq is incremented
+        Chunk& chunk = slots[readSeq % slotCount];
+        lock.unlock();
+        const bool bRead = g_SIGINT == 0 && read_chunk(chunk);
+        lock.lock();
 
-        /*
-        cerr << APP_TITLE" - Exception " << typeid(ex).name() << ": " << ex.what() << 
-          " Row: " << m_countProcessed << ", field: " << get<0>(fieldIndex) << '\n';
-        */
-
-        // If the exception was caused by the above stream operation then terminate.
-        // Otherwise stop current row processing.
-        if (!check_streams())
+        if (bRead)
+        {
+          ++readSeq;
+          cvWorker.notify_one();
+        }
+        else
         {
-          utility::throw_exception<runtime_error>("I/O error during data processing");
+          bInputDone = true;
+          cvWorker.notify_all();
         }
-        ++m_countRejected;
-        string reason(ex.what());
-        m_rejectStream << L"Processing failure for row " << m_countProcessed << L": " << wstring(reason.begin(), reason.end()) << L'\n';
+      }
+      else if (bInputDone && commitSeq == readSeq)
+      {
         break;
       }
+      else
+      {
+        cvCommit.wait(lock);
+      }
+    }
+  }
+  catch (...)
+  {
+    // The exception may come from a commit or a read made without the lock
+    if (!lock.owns_lock())
+    {
+      lock.lock();
+    }
+
+    pException = current_exception();
+    // Prevent the workers from taking the remaining chunks
+    takeSeq = readSeq;
+    bInputDone = true;
+    cvWorker.notify_all();
+  }
+
+  lock.unlock();
+
+  for (auto& t : workers)
+  {
+    t.join();
+  }
+
+  if (pException)
+  {
+    rethrow_exception(pException);
+  }
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+void CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::process_pipeline(unsigned workerCount)
+{
+  // The chunks circulate from the reader thread through the workers to the
+  // writer (the calling thread) and back to the reader. The fixed count of
+  // chunks bounds the memory used, a stage waits if the next one lags behind.
+  const size_t chunkCount = workerCount * s_chunksPerWorker;
+  vector<Chunk> chunks(chunkCount);
+  SpscRing<Chunk*> freeRing(chunkCount);
+  MpscRing<Chunk*> doneRing(chunkCount + workerCount);
+  vector<unique_ptr<SpscRing<Chunk*>>> workerRings;
+  vector<unique_ptr<Scanner>> scanners;
+  atomic<bool> bStop(false);
+  exception_ptr pReaderException;
+
+  for (auto& chunk : chunks)
+  {
+    freeRing.push(&chunk);
+  }
+
+  for (unsigned i = 0; i < workerCount; ++i)
+  {
+    workerRings.emplace_back(new SpscRing<Chunk*>(s_chunksPerWorker));
+    // The scanners keep counts, each worker uses its own scanner
+    scanners.push_back(clone_scanner());
+  }
+
+  auto reader = [&]()
+  {
+    try
+    {
+      Chunk* pChunk;
 
-      if (++i < m_indices.size())
+      for (size_t sequence = 0; !bStop; ++sequence)
       {
-        wsRow << L',';
+        freeRing.pop(pChunk);
+
+        if (bStop || g_SIGINT || !read_chunk(*pChunk))
+        {
+          break;
+        }
+
+        // The workers take the chunks in turns
+        pChunk->sequence = sequence;
+        workerRings[sequence % workerCount]->push(pChunk);
       }
     }
+    catch (...)
+    {
+      pReaderException = current_exception();
+    }
 
-    if (!exceptionCaught)
+    // Tell the workers there are no more chunks
+    for (auto& pRing : workerRings)
     {
-      // do not use: << endl;
-      m_outStream << wsRow.str() << L'\n';
+      pRing->push(nullptr);
     }
+  };
+
+  auto worker = [&](unsigned index)
+  {
+    Chunk* pChunk;
 
-    if (m_countProcessed % s_yieldFrequency == 0)
+    while (true)
     {
-      this_thread::yield();
+      workerRings[index]->pop(pChunk);
+
+      if (!pChunk)
+      {
+        break;
+      }
+
+      // Once stopped, the writer discards the chunks
+      if (!bStop)
+      {
+        process_chunk(*pChunk, *scanners[index]);
+      }
+
+      doneRing.push(pChunk);
     }
+
+    doneRing.push(nullptr);
+  };
+
+  thread readerThread(reader);
+  vector<thread> workers;
+
+  for (unsigned i = 0; i < workerCount; ++i)
+  {
+    workers.emplace_back(worker, i);
   }
 
-  if (!check_streams())
+  // The chunks are processed out of order, hold them until their turn comes.
+  // The chunks in progress have consecutive sequence numbers.
+  vector<Chunk*> pending(chunkCount, nullptr);
+  size_t commitSeq = 0;
+  unsigned finishedWorkers = 0;
+  exception_ptr pException;
+
+  while (finishedWorkers < workerCount)
   {
-    utility::throw_exception<runtime_error>("I/O error during data processing");
+    Chunk* pChunk;
+    doneRing.pop(pChunk);
+
+    if (!pChunk)
+    {
+      ++finishedWorkers;
+      continue;
+    }
+
+    if (pException)
+    {
+      freeRing.push(pChunk);
+      continue;
+    }
+
+    pending[pChunk->sequence % chunkCount] = pChunk;
+
+    for (Chunk* pNext; (pNext = pending[commitSeq % chunkCount]) != nullptr; ++commitSeq)
+    {
+      pending[commitSeq % chunkCount] = nullptr;
+
+      try
+      {
+        commit_chunk(*pNext);
+
+        if (pNext->pException)
+        {
+          rethrow_exception(pNext->pException);
+        }
+      }
+      catch (...)
+      {
+        pException = current_exception();
+      }
+
+      freeRing.push(pNext);
+
+      if (pException)
+      {
+        // Release the chunks waiting for their turn and stop the other stages
+        for (auto& pWaiting : pending)
+        {
+          if (pWaiting)
+          {
+            freeRing.push(pWaiting);
+            pWaiting = nullptr;
+          }
+        }
+
+        bStop = true;
+        break;
+      }
+    }
   }
 
-  ExitCode ret = ExitCode::E_SUCCESS;
+  readerThread.join();
 
-  if (g_SIGINT)
+  for (auto& t : workers)
   {
-    cerr << APP_TITLE" - data processing interrupted" << endl;
-    cerr << APP_TITLE" - terminating on signal, leaving incomplete output files" << endl;
-    ret = ExitCode::E_SIGINT;
+    t.join();
   }
-  else
+
+  for (auto& pScanner : scanners)
   {
-    cout << APP_TITLE" - data processing finished" << endl;
-    cout << APP_TITLE" - processed " << m_countProcessed << " data rows" << endl;
+    m_pScanner->addCounts(*pScanner);
+  }
 
-    if (m_countRejected)
-    {
-      cout << APP_TITLE" - rejected " << m_countRejected << " data rows due to index processing failure" << endl;
-    }
+  if (!pException)
+  {
+    pException = pReaderException;
+  }
+
+  if (pException)
+  {
+    rethrow_exception(pException);
   }
-  
-  m_countRejected += m_pScanner->getRejectedCount();
-  m_countRejectedIndex = m_pProcessor->getRejectedCount();
-  
-  return ret;
 }
 
 template <
   size_t DataFieldCount,
   size_t ProcessorInputFieldCount,
-  size_t ProcessorOutputFieldCount>
-wstring CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount>::performFieldProcessing(const wstring& strIn) const
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+auto CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::clone_scanner() const -> unique_ptr<Scanner>
+{
+  // The clone has the type of the scanner
+  return unique_ptr<Scanner>(static_cast<Scanner*>(m_pScanner->clone().release()));
+}
+
+template <
+  size_t DataFieldCount,
+  size_t ProcessorInputFieldCount,
+  size_t ProcessorOutputFieldCount,
+  typename Scanner,
+  typename Processor>
+auto CsvFile<DataFieldCount,ProcessorInputFieldCount,ProcessorOutputFieldCount,Scanner,Processor>::performFieldProcessing(string_view strIn) const -> typename Processor::Result
 {
   if (strIn.empty())
   {
     // The field(s) that are subject to processing by CsvProcessor are important and cannot be missing
-    utility::throw_exception<invalid_argument>("no field to process");
+    return utility::unexpected(Processor::E_MISSING_FIELD);
   }
 
-  // extend lifetime of rvalue returned by processCsvField()
-  const auto& processingResult = m_pProcessor->processCsvField(strIn);    // throws if processCsvField fails
-  assert(!processingResult[0].empty());
-
-  wostringstream strStream;
-
-  copy(processingResult.cbegin(), processingResult.cend(),
-    ostream_custom_iterator<wstring>(strStream, L","));
-
-  return strStream.str();
+  // The fragment holds the output fields already joined
+  const auto processingResult = m_pProcessor->processField(strIn);
+  assert(!processingResult || !processingResult->empty());
+  return processingResult;
 }
 
 template class CsvFile<
   CsvFieldCounts::s_inputGoogle,
   CsvFieldCounts::s_indexGoogle,
-  CsvFieldCounts::s_processingGoogle>;
+  CsvFieldCounts::s_processingGoogle,
+  CsvScannerGoogle,
+  CsvProcessorGoogle<>>;
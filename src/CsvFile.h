@@ -3,20 +3,51 @@
   e.g. it has no knowledge of what data is contained in which CSV field.
   Therefore this class needs to delegate the data processing work to handlers
   which are the classes derived from CsvScanner and CsvProcessor.
+  The input file is processed in chunks, each chunk being a block of whole
+  lines. The chunks can be processed by several worker threads, in which
+  case the chunks are written to the output files in input order so that
+  the output does not depend on the count of threads. The worker threads
+  either share a queue of chunks read by the calling thread, or form the
+  middle stage of a pipeline: a reader thread, the workers and a writer
+  connected by lock-free ring buffers.
+  In the incremental mode a checkpoint saved after a successful run records
+  the processed part of the input file. If the input file still starts with
+  that part, the next run processes the appended rows only and writes them
+  to the append file (e.g. out-append.csv), otherwise it processes the whole
+  file as usual.
+  Consecutive rows that share the content of the processed field (e.g. the
+  rows of a geoindex in a grouped input file) form a run, the processing
+  result is obtained once per run and reused for the other rows.
+  The scanner and processor classes are template parameters. By default
+  they are the abstract interfaces and the handlers are called through
+  virtual methods. When CsvFile is instantiated with the handler classes
+  (see WorkFactory), their inline scanRow() and processField() hide the
+  ones of the interfaces and the per-row calls are resolved statically.
+  The rows are read and scanned in batches, see RowBatch.
 */
 #pragma once
 
+#include <array>
 #include <memory>
+#include <vector>
+#include <exception>
 #include "WorkUnit.h"
 #include "utility.h"
+#include "StringArena.h"
 #include "config/BuildConfig.h"
+#include "io/InputSource.h"
+#include "io/OutputWriter.h"
+#include "io/RejectWriter.h"
+#include "io/Checkpoint.h"
 #include "handlers/CsvProcessor.h"
 #include "handlers/CsvScanner.h"
 
 template <
   std::size_t DataFieldCount,
   std::size_t ProcessorInputFieldCount,
-  std::size_t ProcessorOutputFieldCount>
+  std::size_t ProcessorOutputFieldCount,
+  typename Scanner = CsvScanner,
+  typename Processor = CsvProcessor<ProcessorInputFieldCount, ProcessorOutputFieldCount>>
 class CsvFile : public IWorkUnit
 {
 public:
@@ -27,9 +58,9 @@ public:
   // needs to be processed by CsvProcessor.
   typedef std::array<std::tuple<unsigned,bool>, DataFieldCount> DataFields;
   // Smart pointer to abstract class that performs CSV field processing
-  typedef std::shared_ptr<CsvProcessor<ProcessorInputFieldCount,ProcessorOutputFieldCount>> ProcessorPtr;
+  typedef std::shared_ptr<Processor> ProcessorPtr;
   // Smart pointer to helper abstract class that performs CSV record scanning
-  typedef std::shared_ptr<CsvScanner> ScannerPtr;
+  typedef std::shared_ptr<Scanner> ScannerPtr;
 
   CsvFile(const std::string& inFile, 
           const std::string& outFile,
@@ -39,23 +70,144 @@ public:
   ~CsvFile();
 
   ExitCode process() override;
-  unsigned getProcessedCount() override { return m_countProcessed; }
-  unsigned getRejectedCount() override { return m_countRejected; }
+  // The counts include the rows processed before the checkpoint
+  unsigned getProcessedCount() override { return m_checkpoint.rows + m_countProcessed; }
+  unsigned getRejectedCount() override { return m_checkpoint.rejectedRows + m_countRejected; }
   unsigned getRejectedIndexCount() override { return m_countRejectedIndex; }
 
 protected:
+  // Consecutive rows sharing the content of the processed field. The key
+  // refers to the data of the chunk where the run starts.
+  struct Run
+  {
+    std::string_view key;
+    unsigned length = 0;
+  };
+
+  // Distribution of the run lengths by order of magnitude: 1, 2-9, 10-99,
+  // 100-999 and 1000 or more rows
+  struct RunStats
+  {
+    void add(unsigned length)
+    {
+      std::size_t bucket = 0;
+
+      // The upper limits of the buckets are 1, 9, 99 and 999
+      for (unsigned limit = 1; bucket + 1 < counts.size() && length > limit; limit = limit == 1 ? 9 : limit * 10 + 9)
+      {
+        ++bucket;
+      }
+
+      ++counts[bucket];
+      rows += length;
+    }
+
+    void merge(const RunStats& other)
+    {
+      for (std::size_t i = 0; i < counts.size(); ++i)
+      {
+        counts[i] += other.counts[i];
+      }
+
+      rows += other.rows;
+    }
+
+    unsigned count() const
+    {
+      unsigned ret = 0;
+
+      for (const auto count : counts)
+      {
+        ret += count;
+      }
+
+      return ret;
+    }
+
+    std::array<unsigned, 5> counts{};
+    unsigned long long rows = 0;
+  };
+
+  // Processing result of a block of rows
+  struct Chunk
+  {
+    // Position of the chunk in the input file
+    std::size_t sequence;
+    std::string_view data;
+    // Copy of the data unless the input source keeps it valid
+    std::string storage;
+    OutputBuffer output;
+    // The rows are numbered from the start of the chunk, the numbers are
+    // offset when the chunk is committed and the count of the preceding
+    // rows is known
+    RejectBatch rejects;
+    // The temporaries of the rows, e.g. the rejection messages. Reset when
+    // the processing of the chunk starts, i.e. once the chunk holding them
+    // has been written.
+    StringArena arena;
+    unsigned countProcessed;
+    unsigned countRejected;
+    unsigned countMalformed;
+    // The first and the last run of the chunk may continue in the adjacent
+    // chunks, they are added to the statistics when the chunk is committed.
+    // The tail is empty if the chunk holds a single run.
+    Run head;
+    Run tail;
+    RunStats runs;
+    // Set if the processing has been stopped by an unexpected exception
+    std::exception_ptr pException;
+  };
+
   bool check_streams() const;
-  std::wstring performFieldProcessing(const std::wstring&) const noexcept(false);
+  // Skips the input processed before the checkpoint, returns false if the
+  // checkpoint is missing or does not match the input
+  bool resume_checkpoint(const std::string& inFile);
+  void save_checkpoint();
+  std::uint64_t fingerprint() const;
+  bool read_chunk(Chunk& chunk);
+  void process_chunk(Chunk& chunk, Scanner& scanner) const noexcept;
+  // Creates a scanner for a worker thread
+  std::unique_ptr<Scanner> clone_scanner() const;
+  void commit_chunk(Chunk& chunk);
+  void commit_runs(const Chunk& chunk);
+  void process_serial();
+  void process_parallel(unsigned workerCount);
+  void process_pipeline(unsigned workerCount);
+  // Returns the processing result to be appended to the output row or the
+  // reason why the row is rejected
+  typename Processor::Result performFieldProcessing(std::string_view) const;
 
   DataFields m_indices;
-  std::wifstream m_inStream;
-  std::wofstream m_outStream;
-  std::wofstream m_rejectStream;
+  std::unique_ptr<InputSource> m_pInSource;
+  OutputWriter m_outWriter;
+  RejectWriter m_rejectWriter;
   ProcessorPtr m_pProcessor;
   ScannerPtr m_pScanner;
   unsigned m_countProcessed;
   unsigned m_countRejected;
+  // Rows violating the CSV quoting rules
+  unsigned m_countMalformed;
   unsigned m_countRejectedIndex;
+  unsigned m_threadCount;
+  bool m_bPipeline;
+  bool m_bIncremental;
+  Checkpoint m_checkpoint;
+  std::string m_checkpointPath;
+  // Hash and size of the input read so far including the checkpoint prefix
+  utility::Hasher m_inputHasher;
+  std::uint64_t m_inputOffset;
+  bool m_bInputTerminated;
+  // The run that may continue in the next chunk, its key is a copy
+  Run m_run;
+  std::string m_runKey;
+  RunStats m_runs;
+
+  typedef enum { E_SCAN, E_PROCESSING, E_MALFORMED } E_REJECTION_REASON;
+  static const std::vector<RejectWriter::Reason> s_rejectReasons;
 
   static const int s_yieldFrequency = 1000;
+  // Approximate size of a chunk of input data in bytes
+  static const std::size_t s_chunkSize = 1 << 20;
+  // Count of chunks that can be in progress per worker thread
+  static const unsigned s_chunksPerWorker = 2;
 };
@@ -1,4 +1,5 @@
 #include <cassert>
+#include <algorithm>
 #include "config/BuildConfig.h"
 #include "CsvRowReader.h"
 
@@ -7,9 +8,6 @@ using namespace std;
 template <size_t FieldCount>
 const string CsvRowReader<FieldCount>::csv_error::s_strWhat{"Incorrectly quoted CSV field"};
 
-template <size_t FieldCount>
-const wregex CsvRowReader<FieldCount>::s_regex{L"^\"[^\"]*?(?:\"\")?[^\"]*?(?:\"\")?[^\"]*?\"(?:,|$)"};
-
 template <size_t FieldCount>
 CsvRowReader<FieldCount>::CsvRowReader(const array<unsigned, FieldCount>& indices)
 {
@@ -19,102 +17,203 @@ CsvRowReader<FieldCount>::CsvRowReader(const array<unsigned, FieldCount>& indice
     utility::throw_exception<invalid_argument>("no row indices requested");
   }
 
+  const unsigned largestIndex = *max_element(indices.cbegin(), indices.cend());
+  m_slots.assign(largestIndex + 1, s_noSlot);
+
   unsigned ordinal = 0;
   for (const auto& ind : indices)
   {
-    m_map.emplace(ind, ordinal++);
-  }
+    // The first occurrence of a repeated index takes precedence
+    if (m_slots[ind] == s_noSlot)
+    {
+      m_slots[ind] = ordinal;
+    }
 
-  locale loc("C.UTF-8");
-  m_lineStream.imbue(loc);
+    ++ordinal;
+  }
 }
 
 template <size_t FieldCount>
 void CsvRowReader<FieldCount>::clear()
 {
-  for (auto& s : m_data)
+  m_data.fill(string_view());
+}
+
+template <size_t FieldCount>
+auto CsvRowReader<FieldCount>::readRow(InputSource& source) -> RowResult
+{
+  string_view line;
+
+  if (!source.getLine(line))
   {
-    s.clear();
+    clear();
+    m_row = string_view();
+    return utility::unexpected(E_END_OF_INPUT);
+  }
+
+  return parse_line(line);
+}
+
+template <size_t FieldCount>
+size_t CsvRowReader<FieldCount>::readBatch(InputSource& source, RowBatch<FieldCount>& batch)
+{
+  assert(source.is_stable());
+  batch.m_pBase = nullptr;
+  batch.m_pSlots = &m_slots;
+  batch.m_size = 0;
+  batch.m_valid = 0;
+
+  for (size_t i = 0; i < batch.s_capacity; ++i)
+  {
+    const auto row = readRow(source);
+
+    if (!row && row.error() == E_END_OF_INPUT)
+    {
+      break;
+    }
+
+    if (i == 0)
+    {
+      batch.m_pBase = m_row.data();
+    }
+
+    batch.m_rowOffsets[i] = m_row.data() - batch.m_pBase;
+    batch.m_rowLengths[i] = m_row.size();
+    batch.m_size = i + 1;
+
+    // The fields of an incorrectly quoted row are left empty
+    if (row)
+    {
+      batch.m_valid |= batch::Mask(1) << i;
+    }
+
+    for (size_t slot = 0; slot < FieldCount; ++slot)
+    {
+      const string_view field = row ? m_data[slot] : string_view();
+      batch.m_offsets[slot][i] = field.empty() ? 0 : field.data() - batch.m_pBase;
+      batch.m_lengths[slot][i] = field.size();
+    }
   }
+
+  return batch.m_size;
 }
 
 template <size_t FieldCount>
-unsigned CsvRowReader<FieldCount>::get_largest_index() const
+void CsvRowReader<FieldCount>::readNextRow(istream& inStream)
 {
-  unsigned ret = m_map.crbegin()->first;
-  return ret;
+  std::getline(inStream, m_line);
+
+  if (!parse_line(m_line))
+  {
+    throw csv_error(m_row);
+  }
 }
 
 template <size_t FieldCount>
-void CsvRowReader<FieldCount>::readNextRow(wistream& inStream)
+void CsvRowReader<FieldCount>::readNextRow(InputSource& source)
 {
-  wstring wstr;
-  std::getline(inStream, wstr);
+  const auto row = readRow(source);
 
-  m_lineStream.str(move(wstr));
-  m_lineStream.clear();
-  m_lineStream.seekg(0);
+  if (!row && row.error() != E_END_OF_INPUT)
+  {
+    throw csv_error(m_row);
+  }
+}
+
+template <size_t FieldCount>
+auto CsvRowReader<FieldCount>::parse_line(string_view line) -> RowResult
+{
+  auto isSpace = [](char c) { return c == ' ' || (c >= '\t' && c <= '\r'); };
 
-  wstring currentField;
+  const size_t len = line.size();
+  const unsigned slotCount = m_slots.size();
   unsigned currentFieldIndex = 0;
-  unsigned largestIndex = get_largest_index();
+  size_t pos = 0;
+  m_classifier.reset(line);
+  m_row = line;
   clear();
 
-  while (m_lineStream >> ws)
+  while (true)
   {
-    if (currentFieldIndex > largestIndex)
-      return;
-
-    bool bQuoted = m_lineStream.peek() == L'"';
+    // Skip whitespace preceding the field
+    while (pos < len && isSpace(line[pos]))
+    {
+      ++pos;
+    }
 
-    if (bQuoted)
+    if (pos >= len || currentFieldIndex >= slotCount)
     {
-      const size_t quoteStart = m_lineStream.tellg();
-      const wstring lineRemainder = m_lineStream.str().substr(quoteStart);
+      return line;
+    }
 
-      wsmatch wsm;
-      bool bMatch = regex_search(lineRemainder, wsm, s_regex);
+    const size_t fieldStart = pos;
+    size_t fieldEnd;
 
-      if (!bMatch)
+    if (line[pos] == '"')
+    {
+      // Quoted field, jump from quote to quote until the closing quote
+      unsigned escapedQuotes = 0;
+      size_t quote = pos;
+
+      while (true)
       {
-        throw csv_error(m_lineStream.str());
+        quote = m_classifier.findQuote(quote + 1);
+
+        if (quote == len)
+        {
+          // Missing closing quote
+          return utility::unexpected(E_MISSING_QUOTE);
+        }
+
+        if (quote + 1 == len || line[quote + 1] != '"')
+        {
+          break;
+        }
+
+        // Escaped quote
+        if (++escapedQuotes > s_maxEscapedQuotes)
+        {
+          return utility::unexpected(E_ESCAPED_QUOTES);
+        }
+
+        ++quote;
       }
 
-      currentField = wsm.str();
-      auto len = currentField.length();
+      fieldEnd = quote + 1;
 
-      if (currentField.back() == L',')
+      // The field retains its quotes and must be followed by comma or end of row
+      if (fieldEnd < len && line[fieldEnd] != ',')
       {
-        currentField.pop_back();
+        return utility::unexpected(E_DATA_AFTER_QUOTE);
       }
-
-      m_lineStream.seekg(quoteStart + len);
     }
     else
     {
-      std::getline(m_lineStream, currentField, L',');
+      // Non-quoted field extends up to the next comma
+      fieldEnd = m_classifier.findComma(pos);
     }
 
-    typename decltype(m_map)::const_iterator it = m_map.find(currentFieldIndex);
+    const unsigned slot = m_slots[currentFieldIndex];
 
-    if (it != m_map.end())
+    if (slot != s_noSlot)
     {
-      store_data(it->second, move(currentField));
+      store_data(slot, line.substr(fieldStart, fieldEnd - fieldStart));
     }
 
     ++currentFieldIndex;
+    pos = fieldEnd + 1;
   }
 }
 
 template <size_t FieldCount>
-void CsvRowReader<FieldCount>::store_data(unsigned ind, wstring&& data)
+void CsvRowReader<FieldCount>::store_data(unsigned ind, string_view data)
 {
   if (ind >= FieldCount)
   {
     utility::throw_exception<out_of_range>("too many fields to extract");
   }
 
-  m_data[ind] = move(data);
+  m_data[ind] = data;
 }
 
 template class CsvRowReader<CsvFieldCounts::s_inputGoogle>;
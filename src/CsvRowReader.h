@@ -1,11 +1,31 @@
 /*
   CsvRowReader extracts the selected subset of CSV fields from CSV row.
+  The row is tokenized in a single forward pass that jumps from one
+  structural character (comma or quote) to the next one using the bitmasks
+  computed by BlockClassifier, so that the fields not requested are skipped
+  without examining their content.
+  Quoted fields follow RFC 4180: a quote character inside a quoted field
+  must be escaped by another quote and the closing quote must be followed
+  by a comma or the end of the row. Like the regex used by earlier versions,
+  the tokenizer accepts at most two escaped quotes per field.
+  A row that violates the quoting rules is reported by readRow() as an
+  error code, readNextRow() and operator>> throw csv_error instead.
+  readBatch() reads a batch of rows in columnar layout, see RowBatch.
+  The extracted fields are views into the row and remain valid until the
+  next row is read. The requested field indices are resolved by a dense
+  slot table, indexed by the field index, built once by the constructor.
 */
 #pragma once
 
-#include <map>
 #include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <istream>
 #include "utility.h"
+#include "BlockClassifier.h"
+#include "RowBatch.h"
+#include "io/InputSource.h"
 
 // FieldCount is the count of the requested fields
 template <std::size_t FieldCount>
@@ -16,68 +36,86 @@ public:
   CsvRowReader(const std::array<unsigned, FieldCount>& indices);
   CsvRowReader(const CsvRowReader&) = delete;
 
-  void readNextRow(std::wistream&);
+  typedef enum { E_END_OF_INPUT, E_MISSING_QUOTE, E_ESCAPED_QUOTES, E_DATA_AFTER_QUOTE } E_ROW_ERROR;
+  // Holds the row unless the input is exhausted or the row is incorrectly quoted
+  typedef utility::Expected<std::string_view, E_ROW_ERROR> RowResult;
 
-  inline const std::wstring& operator[] (std::size_t index) const;
-  auto getReadonlyRow() const -> const std::array<std::wstring, FieldCount>& { return m_data; }
+  RowResult readRow(InputSource&);
+  // Fills the batch with the next rows of the source, returns the count of
+  // the rows. The source must keep the rows valid, see is_stable().
+  std::size_t readBatch(InputSource&, RowBatch<FieldCount>& batch);
+  void readNextRow(std::istream&);
+  void readNextRow(InputSource&);
+  // The last row read, whether or not it has been parsed successfully
+  std::string_view getRow() const { return m_row; }
+
+  inline std::string_view operator[] (std::size_t index) const;
+  auto getReadonlyRow() const -> const std::array<std::string_view, FieldCount>& { return m_data; }
 
 private:
   void clear();
-  void store_data(unsigned ind, std::wstring&& data);
-  unsigned get_largest_index() const;
-
-  std::map<unsigned, unsigned> m_map;
-  std::array<std::wstring, FieldCount> m_data;
-  std::wistringstream m_lineStream;
-  static const std::wregex s_regex;
+  RowResult parse_line(std::string_view line);
+  void store_data(unsigned ind, std::string_view data);
+  // Slot table entry of the fields that are not requested
+  static constexpr unsigned s_noSlot = ~0u;
+
+  // Maps a field index to its ordinal in m_data
+  std::vector<unsigned> m_slots;
+  std::array<std::string_view, FieldCount> m_data;
+  std::string m_line;
+  std::string_view m_row;
+  BlockClassifier m_classifier;
+  static const unsigned s_maxEscapedQuotes = 2;
 
 public:
   // Nested struct to avoid global namespace pollution
   struct csv_error : std::runtime_error
   {
-    explicit csv_error(const std::wstring& strData) : std::runtime_error(s_strWhat), m_strData(strData)
+    explicit csv_error(const std::string& strData) : std::runtime_error(s_strWhat), m_strData(strData)
     {
     }
 
-    explicit csv_error(const std::wstring&& strData) : std::runtime_error(s_strWhat), m_strData(move(strData))
+    explicit csv_error(std::string_view strData) : std::runtime_error(s_strWhat), m_strData(strData)
     {
     }
 
-    std::wstring data() const
+    explicit csv_error(const std::string&& strData) : std::runtime_error(s_strWhat), m_strData(move(strData))
+    {
+    }
+
+    std::string data() const
     {
       return m_strData;
     }
 
   protected:
-    const std::wstring m_strData;             // string returned by data()
+    const std::string m_strData;             // string returned by data()
     static const std::string s_strWhat;       // string returned by what()
   };
 
 };
 
 template <std::size_t FieldCount>
-const std::wstring& CsvRowReader<FieldCount>::operator[] (std::size_t index) const
+std::string_view CsvRowReader<FieldCount>::operator[] (std::size_t index) const
 {
-  typename decltype(m_map)::const_iterator it = m_map.find(index);
-
-  if (it == m_map.end())
+  if (index >= m_slots.size() || m_slots[index] == s_noSlot)
   {
     utility::throw_exception<std::invalid_argument>("the requested row index is invalid");
   }
 
-  unsigned ordinal = std::distance(m_map.cbegin(), it);
-
-  if (ordinal >= FieldCount)
-  {
-    utility::throw_exception<std::out_of_range>("the requested row index is out of range");
-  }
-
-  return m_data[ordinal];
+  return m_data[m_slots[index]];
 }
 
 template <std::size_t FieldCount>
-std::wistream& operator>> (std::wistream& inStream, CsvRowReader<FieldCount>& rowReader)
+std::istream& operator>> (std::istream& inStream, CsvRowReader<FieldCount>& rowReader)
 {
   rowReader.readNextRow(inStream);
   return inStream;
 }
+
+template <std::size_t FieldCount>
+InputSource& operator>> (InputSource& source, CsvRowReader<FieldCount>& rowReader)
+{
+  rowReader.readNextRow(source);
+  return source;
+}
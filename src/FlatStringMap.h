@@ -0,0 +1,142 @@
+/*
+  FlatStringMap maps strings to values with open addressing and linear
+  probing. The table holds 32-bit positions of the entries, the entries
+  are stored in the order of insertion in a vector along with the hash of
+  the key, and the key strings are copied to a StringArena owned by the map.
+  Lookups take a std::string_view and never allocate. The map is meant for
+  dictionaries that are built once and then only looked up, entries cannot
+  be erased.
+*/
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <string.h>
+#include "utility.h"
+#include "StringArena.h"
+
+template <typename Value>
+class FlatStringMap
+{
+public:
+  struct Entry
+  {
+    std::string_view key;
+    Value value;
+    std::uint64_t hash;
+  };
+
+  typedef typename std::vector<Entry>::const_iterator const_iterator;
+
+  FlatStringMap() : m_buckets(s_minBucketCount, 0) {}
+  FlatStringMap(const FlatStringMap&) = delete;
+  FlatStringMap& operator=(const FlatStringMap&) = delete;
+
+  // Inserts the value unless the key is present. Returns the value stored
+  // under the key and whether it has been inserted.
+  std::pair<Value*, bool> emplace(std::string_view key, const Value& value)
+  {
+    const std::uint64_t hash = utility::hashKey(key);
+    std::uint32_t* pBucket = find_bucket(key, hash);
+
+    if (*pBucket != 0)
+    {
+      return { &m_entries[*pBucket - 1].value, false };
+    }
+
+    m_entries.push_back({ m_arena.store(key), value, hash });
+    *pBucket = static_cast<std::uint32_t>(m_entries.size());
+
+    // Keep the load factor at or below one half
+    if (m_entries.size() * 2 > m_buckets.size())
+    {
+      rehash(m_buckets.size() * 2);
+    }
+
+    return { &m_entries.back().value, true };
+  }
+
+  const Value* find(std::string_view key) const
+  {
+    const std::uint32_t pos = *const_cast<FlatStringMap*>(this)->find_bucket(key, utility::hashKey(key));
+    return pos != 0 ? &m_entries[pos - 1].value : nullptr;
+  }
+
+  // Copies a string referred to by a value to the arena of the map
+  std::string_view store(std::string_view str) { return m_arena.store(str); }
+
+  void reserve(std::size_t count)
+  {
+    m_entries.reserve(count);
+
+    if (count * 2 > m_buckets.size())
+    {
+      std::size_t bucketCount = m_buckets.size();
+
+      while (bucketCount < count * 2)
+      {
+        bucketCount <<= 1;
+      }
+
+      rehash(bucketCount);
+    }
+  }
+
+  std::size_t size() const { return m_entries.size(); }
+  bool empty() const { return m_entries.empty(); }
+  // In the order of insertion
+  const_iterator begin() const { return m_entries.begin(); }
+  const_iterator end() const { return m_entries.end(); }
+
+private:
+  // Returns the bucket that holds the key or the empty bucket where the
+  // probing for the key stops
+  std::uint32_t* find_bucket(std::string_view key, std::uint64_t hash)
+  {
+    const std::size_t mask = m_buckets.size() - 1;
+
+    for (std::size_t bucket = hash & mask; ; bucket = (bucket + 1) & mask)
+    {
+      std::uint32_t& pos = m_buckets[bucket];
+
+      if (pos == 0)
+      {
+        return &pos;
+      }
+
+      const Entry& entry = m_entries[pos - 1];
+
+      if (entry.hash == hash && entry.key == key)
+      {
+        return &pos;
+      }
+    }
+  }
+
+  void rehash(std::size_t bucketCount)
+  {
+    m_buckets.assign(bucketCount, 0);
+    const std::size_t mask = bucketCount - 1;
+
+    for (std::size_t i = 0; i < m_entries.size(); ++i)
+    {
+      std::size_t bucket = m_entries[i].hash & mask;
+
+      while (m_buckets[bucket] != 0)
+      {
+        bucket = (bucket + 1) & mask;
+      }
+
+      m_buckets[bucket] = static_cast<std::uint32_t>(i + 1);
+    }
+  }
+
+  // Position of the entry plus one, 0 marks an empty bucket
+  std::vector<std::uint32_t> m_buckets;
+  std::vector<Entry> m_entries;
+  StringArena m_arena;
+
+  static const std::size_t s_minBucketCount = 16;
+};
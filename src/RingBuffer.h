@@ -0,0 +1,203 @@
+/*
+  Bounded lock-free ring buffers that pass items between threads.
+  SpscRing connects a single producer thread with a single consumer thread,
+  MpscRing accepts items from several producer threads. The capacity is
+  rounded up to a power of two. tryPush() fails if the ring is full and
+  tryPop() fails if it is empty. push() and pop() wait until they succeed,
+  so a full ring holds up the producer (back-pressure) and an empty ring
+  holds up the consumer.
+*/
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+
+namespace ring
+{
+  // Avoids false sharing between the producer and consumer indices
+  constexpr std::size_t s_cacheLineSize = 64;
+
+  inline std::size_t roundCapacity(std::size_t capacity)
+  {
+    std::size_t ret = 2;
+
+    while (ret < capacity)
+    {
+      ret <<= 1;
+    }
+
+    return ret;
+  }
+
+  // Spins for a while, then yields and eventually sleeps, so that waiting
+  // threads do not starve the other threads on machines with few CPUs
+  inline void wait(unsigned& attempt)
+  {
+    if (++attempt < 64)
+    {
+      return;
+    }
+
+    if (attempt < 256)
+    {
+      std::this_thread::yield();
+    }
+    else
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  }
+}
+
+template <typename T>
+class SpscRing
+{
+public:
+  explicit SpscRing(std::size_t capacity) :
+    m_mask(ring::roundCapacity(capacity) - 1), m_items(new T[m_mask + 1]), m_head(0), m_tail(0)
+  {
+  }
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  bool tryPush(const T& item)
+  {
+    const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+
+    if (tail - m_head.load(std::memory_order_acquire) > m_mask)
+    {
+      return false;
+    }
+
+    m_items[tail & m_mask] = item;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& item)
+  {
+    const std::size_t head = m_head.load(std::memory_order_relaxed);
+
+    if (head == m_tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    item = m_items[head & m_mask];
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  void push(const T& item)
+  {
+    for (unsigned attempt = 0; !tryPush(item); ring::wait(attempt));
+  }
+
+  void pop(T& item)
+  {
+    for (unsigned attempt = 0; !tryPop(item); ring::wait(attempt));
+  }
+
+private:
+  const std::size_t m_mask;
+  std::unique_ptr<T[]> m_items;
+  // Written by the consumer
+  alignas(ring::s_cacheLineSize) std::atomic<std::size_t> m_head;
+  // Written by the producer
+  alignas(ring::s_cacheLineSize) std::atomic<std::size_t> m_tail;
+};
+
+// Each cell carries a sequence number that tells the producers and the
+// consumer whether the cell is free or holds an item, see Dmitry Vyukov's
+// bounded MPMC queue.
+template <typename T>
+class MpscRing
+{
+public:
+  explicit MpscRing(std::size_t capacity) :
+    m_mask(ring::roundCapacity(capacity) - 1), m_cells(new Cell[m_mask + 1]), m_head(0), m_tail(0)
+  {
+    for (std::size_t i = 0; i <= m_mask; ++i)
+    {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscRing(const MpscRing&) = delete;
+  MpscRing& operator=(const MpscRing&) = delete;
+
+  bool tryPush(const T& item)
+  {
+    std::size_t tail = m_tail.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+      Cell& cell = m_cells[tail & m_mask];
+      const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+      if (sequence == tail)
+      {
+        // The cell is free, claim it
+        if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+        {
+          cell.item = item;
+          cell.sequence.store(tail + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (sequence < tail)
+      {
+        // The cell has not been consumed yet, the ring is full
+        return false;
+      }
+      else
+      {
+        tail = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool tryPop(T& item)
+  {
+    const std::size_t head = m_head.load(std::memory_order_relaxed);
+    Cell& cell = m_cells[head & m_mask];
+
+    if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+    {
+      return false;
+    }
+
+    item = cell.item;
+    cell.sequence.store(head + m_mask + 1, std::memory_order_release);
+    m_head.store(head + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  void push(const T& item)
+  {
+    for (unsigned attempt = 0; !tryPush(item); ring::wait(attempt));
+  }
+
+  void pop(T& item)
+  {
+    for (unsigned attempt = 0; !tryPop(item); ring::wait(attempt));
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<std::size_t> sequence;
+    T item;
+  };
+
+  const std::size_t m_mask;
+  std::unique_ptr<Cell[]> m_cells;
+  // Used by the consumer only
+  alignas(ring::s_cacheLineSize) std::atomic<std::size_t> m_head;
+  // Shared by the producers
+  alignas(ring::s_cacheLineSize) std::atomic<std::size_t> m_tail;
+};
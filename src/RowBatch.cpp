@@ -0,0 +1,95 @@
+#include "RowBatch.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+#if defined(__SSE2__)
+  inline batch::Mask lane_mask(__m128i cmp, size_t row)
+  {
+    return batch::Mask(_mm_movemask_ps(_mm_castsi128_ps(cmp))) << row;
+  }
+
+  inline __m128i load(const int32_t* p)
+  {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  }
+#endif
+}
+
+namespace batch
+{
+  Mask isZero(const Column& column)
+  {
+    Mask ret = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (size_t i = 0; i < s_capacity; i += 4)
+    {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(column.data() + i));
+      ret |= lane_mask(_mm_cmpeq_epi32(v, zero), i);
+    }
+#else
+    for (size_t i = 0; i < s_capacity; ++i)
+    {
+      ret |= Mask(column[i] == 0) << i;
+    }
+#endif
+
+    return ret;
+  }
+
+  Mask isEqual(const Values& values, int32_t value)
+  {
+    Mask ret = 0;
+
+#if defined(__SSE2__)
+    const __m128i v2 = _mm_set1_epi32(value);
+
+    for (size_t i = 0; i < s_capacity; i += 4)
+    {
+      ret |= lane_mask(_mm_cmpeq_epi32(load(values.data() + i), v2), i);
+    }
+#else
+    for (size_t i = 0; i < s_capacity; ++i)
+    {
+      ret |= Mask(values[i] == value) << i;
+    }
+#endif
+
+    return ret;
+  }
+
+  Mask isInRange(const Values& values, int32_t first, int32_t last)
+  {
+    Mask ret = 0;
+
+#if defined(__SSE2__)
+    const __m128i lo = _mm_set1_epi32(first);
+    const __m128i hi = _mm_set1_epi32(last);
+
+    for (size_t i = 0; i < s_capacity; i += 4)
+    {
+      const __m128i v = load(values.data() + i);
+      // Out of range if below the first value or above the last one
+      const __m128i out = _mm_or_si128(_mm_cmplt_epi32(v, lo), _mm_cmpgt_epi32(v, hi));
+      ret |= lane_mask(out, i);
+    }
+
+    ret = ~ret;
+#else
+    for (size_t i = 0; i < s_capacity; ++i)
+    {
+      ret |= Mask(values[i] >= first && values[i] <= last) << i;
+    }
+#endif
+
+    return ret;
+  }
+}
@@ -0,0 +1,113 @@
+/*
+  RowBatch holds a batch of up to 64 rows read by CsvRowReader in columnar
+  (struct-of-arrays) layout: for each requested field the offsets and the
+  lengths of its content in all the rows of the batch. Bit N of a row mask
+  stands for row N of the batch, so that a predicate evaluated over a
+  column yields the mask of the rows satisfying it and the predicates are
+  combined by bitwise operations instead of branching on each row.
+  The offsets are relative to the first row of the batch, the batch refers
+  to the data of the input source and remains valid as long as the data.
+*/
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include "utility.h"
+
+// Predicates evaluated over a column of values, one value per row. The
+// values are compared four at a time using SSE2 on x86-64.
+namespace batch
+{
+  typedef std::uint64_t Mask;
+  constexpr std::size_t s_capacity = 64;
+  typedef std::array<std::uint32_t, s_capacity> Column;
+  typedef std::array<std::int32_t, s_capacity> Values;
+
+  // The mask of the first count rows
+  constexpr Mask firstRows(std::size_t count)
+  {
+    return count >= s_capacity ? ~Mask(0) : (Mask(1) << count) - 1;
+  }
+
+  Mask isZero(const Column& column);
+  Mask isEqual(const Values& values, std::int32_t value);
+  Mask isInRange(const Values& values, std::int32_t first, std::int32_t last);
+}
+
+template <std::size_t FieldCount>
+class RowBatch
+{
+public:
+  typedef batch::Mask Mask;
+  static constexpr std::size_t s_capacity = batch::s_capacity;
+
+  RowBatch() : m_pBase(nullptr), m_pSlots(nullptr), m_size(0), m_valid(0) {}
+
+  std::size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  Mask allRows() const { return batch::firstRows(m_size); }
+  // The rows parsed successfully, the others are incorrectly quoted
+  Mask validRows() const { return m_valid; }
+
+  std::string_view getRow(std::size_t row) const
+  {
+    return std::string_view(m_pBase + m_rowOffsets[row], m_rowLengths[row]);
+  }
+
+  // The content of the field with the given CSV field index, see
+  // CsvRowReader::operator[]
+  std::string_view field(unsigned index, std::size_t row) const
+  {
+    return getField(ordinal(index), row);
+  }
+
+  // The content of the field with the given ordinal, i.e. the position of
+  // its index in the requested indices
+  std::string_view getField(unsigned ordinal, std::size_t row) const
+  {
+    return std::string_view(m_pBase + m_offsets[ordinal][row], m_lengths[ordinal][row]);
+  }
+
+  // The fields of a row in the order of the requested indices
+  std::array<std::string_view, FieldCount> getFields(std::size_t row) const
+  {
+    std::array<std::string_view, FieldCount> ret;
+
+    for (unsigned i = 0; i < FieldCount; ++i)
+    {
+      ret[i] = getField(i, row);
+    }
+
+    return ret;
+  }
+
+  unsigned ordinal(unsigned index) const
+  {
+    if (!m_pSlots || index >= m_pSlots->size() || (*m_pSlots)[index] >= FieldCount)
+    {
+      utility::throw_exception<std::invalid_argument>("the requested row index is invalid");
+    }
+
+    return (*m_pSlots)[index];
+  }
+
+  // The lengths of the field in all the rows, zero in the invalid rows
+  const batch::Column& lengths(unsigned ordinal) const { return m_lengths[ordinal]; }
+  // The rows whose field with the given ordinal is empty
+  Mask emptyRows(unsigned ordinal) const { return batch::isZero(m_lengths[ordinal]) & allRows(); }
+
+private:
+  template <std::size_t> friend class CsvRowReader;
+
+  const char* m_pBase;
+  // The slot table of the reader, see CsvRowReader
+  const std::vector<unsigned>* m_pSlots;
+  std::size_t m_size;
+  Mask m_valid;
+  batch::Column m_rowOffsets;
+  batch::Column m_rowLengths;
+  std::array<batch::Column, FieldCount> m_offsets;
+  std::array<batch::Column, FieldCount> m_lengths;
+};
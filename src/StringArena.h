@@ -0,0 +1,103 @@
+/*
+  StringArena is a bump allocator for strings. The strings are copied to
+  large blocks of memory and remain valid and in place until the arena is
+  reset or destroyed. Nothing is freed individually: reset() releases all
+  the strings at once and keeps the blocks for reuse, so that an arena
+  reset after each chunk of rows stops allocating once it has grown to the
+  size needed by a chunk.
+*/
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string_view>
+#include <initializer_list>
+#include <string.h>
+
+class StringArena
+{
+public:
+  StringArena() : m_block(0), m_used(0), m_capacity(0) {}
+  StringArena(const StringArena&) = delete;
+  StringArena& operator=(const StringArena&) = delete;
+
+  std::string_view store(std::string_view str)
+  {
+    return concat({ str });
+  }
+
+  // Copies the strings one after another, returns the resulting string
+  std::string_view concat(std::initializer_list<std::string_view> strs)
+  {
+    std::size_t size = 0;
+
+    for (const auto str : strs)
+    {
+      size += str.size();
+    }
+
+    if (size == 0)
+    {
+      return std::string_view();
+    }
+
+    char* const pCopy = allocate(size);
+    char* p = pCopy;
+
+    for (const auto str : strs)
+    {
+      ::memcpy(p, str.data(), str.size());
+      p += str.size();
+    }
+
+    return std::string_view(pCopy, size);
+  }
+
+  // Invalidates the strings stored so far
+  void reset()
+  {
+    m_block = 0;
+    m_used = 0;
+    m_capacity = m_blocks.empty() ? 0 : m_blocks.front().size;
+  }
+
+private:
+  struct Block
+  {
+    std::unique_ptr<char[]> data;
+    std::size_t size;
+  };
+
+  char* allocate(std::size_t size)
+  {
+    while (m_capacity - m_used < size)
+    {
+      // Move on to the next retained block, or add a block
+      if (m_block + 1 < m_blocks.size())
+      {
+        ++m_block;
+      }
+      else
+      {
+        const std::size_t blockSize = size > s_blockSize ? size : s_blockSize;
+        m_blocks.push_back({ std::unique_ptr<char[]>(new char[blockSize]), blockSize });
+        m_block = m_blocks.size() - 1;
+      }
+
+      m_used = 0;
+      m_capacity = m_blocks[m_block].size;
+    }
+
+    char* ret = m_blocks[m_block].data.get() + m_used;
+    m_used += size;
+    return ret;
+  }
+
+  std::vector<Block> m_blocks;
+  // The block in use and the space used in it
+  std::size_t m_block;
+  std::size_t m_used;
+  std::size_t m_capacity;
+
+  static const std::size_t s_blockSize = 64 << 10;
+};
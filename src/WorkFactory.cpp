@@ -1,16 +1,21 @@
 #include <fstream>
 #include "CsvFile.h"
 #include "handlers/HandlerFactory.h"
+#include "handlers/CsvScannerGoogle.h"
+#include "handlers/CsvProcessorGoogle.h"
 #include "WorkFactory.h"
 
 using namespace std;
 
 namespace
 {
+  // The handlers are called without virtual dispatch, see CsvFile
   typedef CsvFile<
     CsvFieldCounts::s_inputGoogle,
     CsvFieldCounts::s_indexGoogle,
-    CsvFieldCounts::s_processingGoogle
+    CsvFieldCounts::s_processingGoogle,
+    CsvScannerGoogle,
+    CsvProcessorGoogle<>
   > GoogleCsvFile;
 }
 
@@ -38,8 +43,10 @@ shared_ptr<IWorkUnit> WorkFactory::createWorkUnit(
       auto pHandler = HandlerFactory::createCsvProcessor<CsvFieldCounts::s_indexGoogle>(
         HandlerFactory::E_GoogleCsvProcessor,
         indexFile);
-      auto pProcessor = static_pointer_cast<HandlerFactory::GoogleCsvProcessor>(pHandler);
-      auto pScanner = HandlerFactory::createCsvScanner(HandlerFactory::E_GoogleCsvScanner);
+      auto pProcessor = static_pointer_cast<CsvProcessorGoogle<>>(
+        static_pointer_cast<HandlerFactory::GoogleCsvProcessor>(pHandler));
+      auto pScanner = static_pointer_cast<CsvScannerGoogle>(
+        HandlerFactory::createCsvScanner(HandlerFactory::E_GoogleCsvScanner));
       string dataFile(utility::constructPath(inFile));
       string outputFile(utility::constructPath(outFile));
       auto ptr = std::shared_ptr<IWorkUnit>(new GoogleCsvFile(dataFile, outputFile, move(fields), move(pProcessor), move(pScanner)));
@@ -11,6 +11,15 @@ namespace
   const string filterAuDataLiteral("filterAuData");
   const string filterUkNutsLiteral("filterUkNuts");
   const string relaxIndexChecksLiteral("relaxIndexChecks");
+  const string mapInputFilesLiteral("mapInputFiles");
+  const string processingThreadsLiteral("processingThreads");
+  const string pipelineProcessingLiteral("pipelineProcessing");
+  const string rejectLimitLiteral("rejectLimit");
+  const string rejectSamplingLiteral("rejectSampling");
+  const string outputCompressionLiteral("outputCompression");
+  const string compressionThreadsLiteral("compressionThreads");
+  const string incrementalProcessingLiteral("incrementalProcessing");
+  const string indexSnapshotLiteral("indexSnapshot");
   const string processedDataLiteral("processedDataRows");
   const string rejectedDataLiteral("rejectedDataRows");
   const string rejectedIndexLiteral("rejectedIndexRows");
@@ -20,6 +29,15 @@ RuntimeConfig::RuntimeConfig() :
   m_filterUkNuts(s_filterUkNuts),
   m_filterAuData(s_filterAuData),
   m_relaxIndexChecks(s_relaxIndexChecks),
+  m_mapInputFiles(s_mapInputFiles),
+  m_processingThreads(s_processingThreads),
+  m_pipelineProcessing(s_pipelineProcessing),
+  m_rejectLimit(s_rejectLimit),
+  m_rejectSampling(s_rejectSampling),
+  m_outputCompression(s_outputCompression),
+  m_compressionThreads(s_compressionThreads),
+  m_incrementalProcessing(s_incrementalProcessing),
+  m_indexSnapshot(s_indexSnapshot),
   m_processedDataRowsThreshold(s_processedDataRowsThreshold),
   m_rejectedDataRowsThreshold(s_rejectedDataRowsThreshold),
   m_rejectedIndexRowsThreshold(s_rejectedDataRowsThreshold)
@@ -37,6 +55,15 @@ RuntimeConfig& RuntimeConfig::operator=(const RuntimeConfig& c)
   m_filterUkNuts = c.m_filterUkNuts;
   m_filterAuData = c.m_filterAuData;
   m_relaxIndexChecks = c.m_relaxIndexChecks;
+  m_mapInputFiles = c.m_mapInputFiles;
+  m_processingThreads = c.m_processingThreads;
+  m_pipelineProcessing = c.m_pipelineProcessing;
+  m_rejectLimit = c.m_rejectLimit;
+  m_rejectSampling = c.m_rejectSampling;
+  m_outputCompression = c.m_outputCompression;
+  m_compressionThreads = c.m_compressionThreads;
+  m_incrementalProcessing = c.m_incrementalProcessing;
+  m_indexSnapshot = c.m_indexSnapshot;
   m_processedDataRowsThreshold = c.m_processedDataRowsThreshold;
   m_rejectedDataRowsThreshold = c.m_rejectedDataRowsThreshold;
   m_rejectedIndexRowsThreshold = c.m_rejectedIndexRowsThreshold;
@@ -51,6 +78,16 @@ RuntimeConfig& RuntimeConfig::operator=(const nh::json& j)
   m_processedDataRowsThreshold = j[processedDataLiteral];
   m_rejectedDataRowsThreshold = j[rejectedDataLiteral];
   m_rejectedIndexRowsThreshold = j[rejectedIndexLiteral];
+  // Optional keys missing from the configuration files created by earlier versions
+  m_mapInputFiles = j.value(mapInputFilesLiteral, m_mapInputFiles);
+  m_processingThreads = j.value(processingThreadsLiteral, m_processingThreads);
+  m_pipelineProcessing = j.value(pipelineProcessingLiteral, m_pipelineProcessing);
+  m_rejectLimit = j.value(rejectLimitLiteral, m_rejectLimit);
+  m_rejectSampling = j.value(rejectSamplingLiteral, m_rejectSampling);
+  m_outputCompression = j.value(outputCompressionLiteral, m_outputCompression);
+  m_compressionThreads = j.value(compressionThreadsLiteral, m_compressionThreads);
+  m_incrementalProcessing = j.value(incrementalProcessingLiteral, m_incrementalProcessing);
+  m_indexSnapshot = j.value(indexSnapshotLiteral, m_indexSnapshot);
   return *this;
 }
 
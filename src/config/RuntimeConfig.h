@@ -13,6 +13,15 @@ struct IRuntimeConfig
   virtual bool getFilterAuData() const = 0;
   virtual bool getFilterUkNuts() const = 0;
   virtual bool getRelaxIndexChecks() const = 0;
+  virtual bool getMapInputFiles() const = 0;
+  virtual unsigned getProcessingThreads() const = 0;
+  virtual bool getPipelineProcessing() const = 0;
+  virtual unsigned getRejectLimit() const = 0;
+  virtual unsigned getRejectSampling() const = 0;
+  virtual const std::string& getOutputCompression() const = 0;
+  virtual unsigned getCompressionThreads() const = 0;
+  virtual bool getIncrementalProcessing() const = 0;
+  virtual bool getIndexSnapshot() const = 0;
   virtual unsigned getProcessedDataRowsThreshold() const = 0;
   virtual unsigned getRejectedDataRowsThreshold() const = 0;
   virtual unsigned getRejectedIndexRowsThreshold() const = 0;
@@ -31,6 +40,15 @@ protected:
   bool getFilterAuData() const override { return m_filterAuData; }
   bool getFilterUkNuts() const override { return m_filterUkNuts; }
   bool getRelaxIndexChecks() const override { return m_relaxIndexChecks; }
+  bool getMapInputFiles() const override { return m_mapInputFiles; }
+  unsigned getProcessingThreads() const override { return m_processingThreads; }
+  bool getPipelineProcessing() const override { return m_pipelineProcessing; }
+  unsigned getRejectLimit() const override { return m_rejectLimit; }
+  unsigned getRejectSampling() const override { return m_rejectSampling; }
+  const std::string& getOutputCompression() const override { return m_outputCompression; }
+  unsigned getCompressionThreads() const override { return m_compressionThreads; }
+  bool getIncrementalProcessing() const override { return m_incrementalProcessing; }
+  bool getIndexSnapshot() const override { return m_indexSnapshot; }
   unsigned getProcessedDataRowsThreshold() const override { return m_processedDataRowsThreshold; }
   unsigned getRejectedDataRowsThreshold() const override { return m_rejectedDataRowsThreshold; }
   unsigned getRejectedIndexRowsThreshold() const override { return m_rejectedIndexRowsThreshold; }
@@ -50,6 +68,24 @@ protected:
   bool m_filterAuData;
   // Skip some index checks
   bool m_relaxIndexChecks;
+  // Memory map the input files instead of reading them
+  bool m_mapInputFiles;
+  // Count of threads processing the data file, 0 stands for the CPU count
+  unsigned m_processingThreads;
+  // Use reader, worker and writer threads connected by ring buffers
+  bool m_pipelineProcessing;
+  // Count of rejects written per reason (0 for all) and the sampling rate
+  // of the rejects beyond that count (0 for none)
+  unsigned m_rejectLimit;
+  unsigned m_rejectSampling;
+  // Compression of the output file: "gzip", "zstd" or empty for none
+  std::string m_outputCompression;
+  // Count of threads compressing the output, 0 stands for the CPU count
+  unsigned m_compressionThreads;
+  // Process only the rows appended since the last checkpoint
+  bool m_incrementalProcessing;
+  // Save the index dictionary to a snapshot file and reuse it
+  bool m_indexSnapshot;
   // Thresholds that affect program's exit code
   unsigned m_processedDataRowsThreshold;
   unsigned m_rejectedDataRowsThreshold;
@@ -59,6 +95,15 @@ protected:
   static const bool s_filterUkNuts = true;
   static const bool s_filterAuData = true;
   static const bool s_relaxIndexChecks = false;
+  static const bool s_mapInputFiles = true;
+  static const unsigned s_processingThreads = 1;
+  static const bool s_pipelineProcessing = false;
+  static const unsigned s_rejectLimit = 0;
+  static const unsigned s_rejectSampling = 0;
+  static constexpr const char* s_outputCompression = "";
+  static const unsigned s_compressionThreads = 0;
+  static const bool s_incrementalProcessing = false;
+  static const bool s_indexSnapshot = true;
   static const unsigned s_processedDataRowsThreshold = 1500000;
   static const unsigned s_rejectedDataRowsThreshold = 100;
   static const unsigned s_rejectedIndexRowsThreshold = 10;
@@ -10,7 +10,7 @@ template <
   size_t InputFieldCount,
   size_t OutputFieldCount>
 CsvProcessor<InputFieldCount, OutputFieldCount>::CsvProcessor(InputFields&& indices) :
-  m_indices(move(indices))
+  m_indices(move(indices)), m_fingerprint(0)
 {
   if (bool bValid = indices.size() > 0; !bValid)
   {
@@ -37,18 +37,35 @@ CsvProcessor<InputFieldCount, OutputFieldCount>::~CsvProcessor()
 template <
   size_t InputFieldCount,
   size_t OutputFieldCount>
-auto CsvProcessor<InputFieldCount, OutputFieldCount>::processCsvField(const wstring& wField) const -> OutputFields
+auto CsvProcessor<InputFieldCount, OutputFieldCount>::processCsvField(string_view field) const -> Result
 {
-  if (wField.empty())
+  if (field.empty())
   {
     // The field that needs to be processed is important and cannot be missing
-    utility::throw_exception<invalid_argument>("missing field to process");
+    return utility::unexpected(E_MISSING_FIELD);
   }
   
-  auto ret = process_internal(wField);
+  auto ret = process_internal(field);
   return ret;
 }
 
+template <
+  size_t InputFieldCount,
+  size_t OutputFieldCount>
+string_view CsvProcessor<InputFieldCount, OutputFieldCount>::describeError(E_ERROR error, string_view field, StringArena& arena)
+{
+  // Worded as the exceptions thrown by utility::throw_exception
+  switch (error)
+  {
+    case E_MISSING_FIELD:
+      return arena.store("CsvProcessor - no field to process");
+    case E_NOT_FOUND:
+      return arena.concat({ "CsvProcessor - lookup failed: index \'", field, "\' not found" });
+  }
+
+  return string_view();
+}
+
 template class CsvProcessor<
   CsvFieldCounts::s_indexGoogle,
   CsvFieldCounts::s_processingGoogle>;
@@ -1,9 +1,17 @@
 /*
-  Handler used by CsvFile to process a CSV field.
+  Handler used by CsvFile to process a CSV field. The field is replaced
+  with the output fields rendered as a single fragment of a CSV row.
+  A field that cannot be processed is reported by an error code rather than
+  an exception, the row is then rejected.
 */
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "../utility.h"
+#include "../StringArena.h"
 
 /*
   Abstract class, defines non-virtual interface.
@@ -11,25 +19,40 @@
 template <
   // How many fields need to be extracted to build lookup dictionary
   std::size_t InputFieldCount,
-  // How many fields can be included into lookup result
+  // How many fields the lookup result consists of
   std::size_t OutputFieldCount>
 class CsvProcessor : public utility::Counter
 {
 public:
   typedef std::array<unsigned, InputFieldCount> InputFields;
-  typedef std::array<std::wstring, OutputFieldCount> OutputFields;
+  typedef enum { E_MISSING_FIELD, E_NOT_FOUND } E_ERROR;
+  // Holds the output fields or the reason of the failure
+  typedef utility::Expected<std::string_view, E_ERROR> Result;
 
   CsvProcessor(InputFields&& indices);
   ~CsvProcessor();
 
-  // Public non-virtual interface
-  OutputFields processCsvField(const std::wstring& field) const noexcept(false);
+  // Public non-virtual interface. Returns OutputFieldCount fields separated
+  // by commas, the view refers to the data owned by the processor.
+  Result processCsvField(std::string_view field) const;
+  // The classes implementing the interface hide this method with an inline
+  // one that is called directly by CsvFile instantiated with the class
+  Result processField(std::string_view field) const
+  {
+    return processCsvField(field);
+  }
+  // Describes the failure to process the field, e.g. for the reject file.
+  // The description is stored in the arena.
+  static std::string_view describeError(E_ERROR error, std::string_view field, StringArena& arena);
+  // Changes whenever the processing of the fields changes
+  std::uint64_t getFingerprint() const { return m_fingerprint; }
 
 protected:
   InputFields m_indices;
+  std::uint64_t m_fingerprint;
 
 private:
   // Private virtual interface meant to hide the existence of derived classes
   // (implementing this interface) from classes that use CsvProcessor
-  virtual OutputFields process_internal(const std::wstring& field) const noexcept(false) = 0;
+  virtual Result process_internal(std::string_view field) const = 0;
 };
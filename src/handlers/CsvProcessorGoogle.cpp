@@ -1,26 +1,71 @@
 #include <cassert>
+#include <deque>
+#include <atomic>
 #include <thread>
-#include <codecvt>
+#include <algorithm>
+#include <charconv>
+#include <iostream>
 #include "../main.h"
 #include "../CsvRowReader.h"
-#include "../iterator.h"
 #include "../utility.h"
 #include "../config/RuntimeConfig.h"
 #include "CsvProcessorGoogle.h"
 
 using namespace std;
 
+namespace
+{
+  // Identifies the settings that affect the dictionary
+  uint64_t snapshot_settings()
+  {
+    utility::Hasher hasher;
+    hasher.update(g_skipLocalitiesBelowStateOrProvince);
+    hasher.update(RuntimeConfig::GetInstance().getRelaxIndexChecks());
+    hasher.update(string_view(STRINGIFY(CSV_VERSION)));
+    return hasher.value();
+  }
+}
+
+template <
+  size_t InputFieldCount,
+  size_t OutputFieldCount>
+const set<string, less<>>
+CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::s_shortLocalities{ "Bo" };
+
 template <
   size_t InputFieldCount,
   size_t OutputFieldCount>
-const set<wstring>
-CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::s_shortLocalities{ L"Bo" };
+const array<string_view, 4>
+CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::s_aggLevels{ "0", "1", "2", "3" };
+
+template <
+  size_t InputFieldCount,
+  size_t OutputFieldCount>
+const vector<RejectWriter::Reason>
+CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::s_rejectReasons{
+  { "Unspecified", "", false },
+  { "Repetition", "Repetition: ", false },
+  { "Invalid aggregation level", "Invalid aggregation level: ", false },
+  { "Invalid index literal", "Invalid index literal: ", false },
+  { "Mismatch between aggregation level and index literal",
+    "Mismatch between aggregation level and index literal: ", false },
+  { "State/province data is inconsistent with index literal",
+    "State/province data is inconsistent with index literal: ", false },
+  { "Invalid country/state/province length", "Invalid country/state/province length: ", false },
+  { "Locality (subregion2_name and/or locality_name) data is inconsistent with index literal",
+    "Locality (subregion2_name and/or locality_name) data is inconsistent with index literal: ", false },
+  { "Locality (subregion2_name and/or locality_name) data has invalid length",
+    "Locality (subregion2_name and/or locality_name) data has invalid length: ", false },
+  { "Invalid CSV data", "Invalid CSV data: ", false }
+};
 
 template <
   size_t InputFieldCount,
   size_t OutputFieldCount>
 CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::CsvProcessorGoogle(const std::string& inFile, typename Base::InputFields&& indices) : 
-  Base(move(indices))
+  Base(move(indices)),
+  m_rejectWriter(s_rejectReasons,
+    RuntimeConfig::GetInstance().getRejectLimit(), RuntimeConfig::GetInstance().getRejectSampling())
 {
   if (inFile.empty())
   {
@@ -28,18 +73,13 @@ CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::CsvProcessorGoogle(const
     utility::throw_exception<invalid_argument>("invalid index file");
   }
 
-  m_inStream.open(inFile.c_str(), ios::binary);
+  m_pInSource = InputSource::create(inFile, RuntimeConfig::GetInstance().getMapInputFiles());
   
   string rejectFile = inFile;
   const char* insertion = "-reject";
   size_t ind = rejectFile.find_last_of(".'");
   rejectFile.insert(ind, insertion);
-  m_rejectStream.open(rejectFile.c_str(), ios::binary | ios::trunc);
-
-  locale loc("C.UTF-8");
-  const locale utf8_loc = locale(std::locale(), new std::codecvt_utf8<wchar_t>);
-  m_inStream.imbue(utf8_loc);
-  m_rejectStream.imbue(loc);
+  m_rejectWriter.open(rejectFile);
 
   if (!check_streams())
   {
@@ -47,10 +87,25 @@ CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::CsvProcessorGoogle(const
     utility::throw_exception<runtime_error>("failed to open index files");
   }
 
-  if (!build_dictionary())
+  const string snapshotFile = inFile + ".snapshot";
+  DictionarySnapshot::Key key;
+  const bool bSnapshot = RuntimeConfig::GetInstance().getIndexSnapshot() &&
+    DictionarySnapshot::getKey(inFile, snapshot_settings(), key);
+
+  if (bSnapshot && load_dictionary(snapshotFile, key))
+  {
+    return;
+  }
+
+  if (!build_dictionary(key))
   {
     utility::throw_exception<runtime_error>("failed to build lookup dictionary");
   }
+
+  if (bSnapshot && !m_dictionary.save(snapshotFile))
+  {
+    cerr << APP_TITLE" - failed to save index snapshot" << endl;
+  }
 }
 
 template <
@@ -58,8 +113,8 @@ template <
   size_t OutputFieldCount>
 bool CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::check_streams() const
 {
-  bool ret = m_inStream.is_open() && !m_inStream.bad() &&
-    m_rejectStream.is_open() && !m_rejectStream.bad();
+  bool ret = m_pInSource && m_pInSource->is_open() && !m_pInSource->bad() &&
+    m_rejectWriter.is_open() && !m_rejectWriter.bad();
 
   return ret;
 }
@@ -67,202 +122,189 @@ bool CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::check_streams() cons
 template <
   size_t InputFieldCount,
   size_t OutputFieldCount>
-bool CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::build_dictionary()
+bool CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::build_dictionary(const DictionarySnapshot::Key& key)
 {
-  int rowCount = 0;
-  CsvRowReader<InputFieldCount> rowReader(m_indices);
-
-  auto incrementRowCount = [&rowCount]() { ++rowCount; };
-
-  typedef enum {
-                  E_UNSPECIFIED,
-                  E_REPETITION,
-                  E_AGG_LEVEL,
-                  E_REGEX,
-                  E_MISMATCH,
-                  E_DATA,
-                  E_LENGTH,
-                  E_LOCALITY,
-                  E_LOCALITY_LENGTH
-                } E_REJECTION_REASON;
-
-  auto saveRejectedRow = [this, &rowReader](E_REJECTION_REASON reason = E_UNSPECIFIED) {
-      const auto& row = rowReader.getReadonlyRow();
-      switch (reason)
-      {
-        case E_REPETITION:
-          m_rejectStream << L"Repetition: ";
-          break;
-        case E_AGG_LEVEL:
-          m_rejectStream << L"Invalid aggregation level: ";
-          break;
-        case E_REGEX:
-          m_rejectStream << L"Invalid index literal: ";
-          break;
-        case E_MISMATCH:
-          m_rejectStream << L"Mismatch between aggregation level and index literal: ";
-          break;
-        case E_DATA:
-          m_rejectStream << L"State/province data is inconsistent with index literal: ";
-          break;
-        case E_LENGTH:
-          m_rejectStream << L"Invalid country/state/province length: ";
-          break;
-        case E_LOCALITY:
-          m_rejectStream << L"Locality (subregion2_name and/or locality_name) data is inconsistent with index literal: ";
-          break;
-        case E_LOCALITY_LENGTH:
-          m_rejectStream << L"Locality (subregion2_name and/or locality_name) data has invalid length: ";
-          break;
-        case E_UNSPECIFIED:
-          break;
-        default:
-          m_rejectStream << L"Unexpected rejection reason: ";
-          break;
-      };
-      copy(row.cbegin(), row.cend(), ostream_custom_iterator<wstring>(m_rejectStream, L","));
-      m_rejectStream << L'\n';
-  };
-
-  cout << APP_TITLE" - processing index" << endl;
+  LookupMap map;
+  // The rejects are kept for the snapshot
+  RejectBatch rejects;
 
-  while (g_SIGINT == 0)
-  {
-    using csv_error = typename CsvRowReader<InputFieldCount>::csv_error;
-    utility::ScopedAction sa(incrementRowCount);
+  // The fingerprint covers the dictionary entries in the order of insertion
+  utility::Hasher hasher;
+  OutputBuffer fragment;
 
-    try
+  auto hashEntry = [&hasher](initializer_list<string_view> fields, unsigned long level) {
+    for (const auto field : fields)
     {
-      if (!(m_inStream >> rowReader))
-        break;
+      hasher.update(field.size());
+      hasher.update(field);
     }
-    catch (const csv_error& ex)
+
+    hasher.update(level);
+  };
+
+  // Renders the output fields of an inserted entry
+  auto renderEntry = [&map, &fragment](string_view index, DictionarySnapshot::Entry& entry) {
+    fragment.clear();
+    fragment.appendField(index);
+    fragment.appendField(entry.country);
+    fragment.appendField(entry.state);
+
+    if constexpr (g_skipLocalitiesBelowStateOrProvince == false)
     {
-      ++m_countRejected;
-      m_rejectStream << L"Invalid CSV data: " << ex.data() << L'\n';
-      continue;
+      fragment.appendField(entry.locality);
     }
 
-    const auto& aggLevel = rowReader[m_indices.back()];
-    unsigned long level = 0L;
-    try
+    fragment.appendField(s_aggLevels[entry.level]);
+    entry.fragment = map.store(fragment.data());
+  };
+
+  // Inserts a validated row unless its geoindex is already present
+  auto insertRow = [this, &map, &rejects, &hashEntry, &renderEntry](const IndexRow& row, size_t rowOffset) {
+    const auto index = row.index();
+    const auto countryName = row.country();
+    const auto stateName = row.state();
+    DictionarySnapshot::Entry entry;
+
+    if constexpr (g_skipLocalitiesBelowStateOrProvince == true)
     {
-      level = std::stoul(aggLevel);
+      entry = { map.store(countryName), map.store(stateName),
+        string_view(), stateName.empty() ? 0u : 1u, string_view() };
     }
-    catch (const exception&)
+    else
     {
-      ++m_countRejected;
-      saveRejectedRow(E_AGG_LEVEL);
-      continue;
+      entry = { map.store(countryName), map.store(stateName),
+        map.store(row.locality()), static_cast<unsigned>(row.level), string_view() };
     }
 
-    const auto& index = rowReader[m_indices.front()];
-    wsmatch mr;
-    if (bool bMatch = regex_match(index, mr, utility::g_regexIndex); !bMatch)
+    const auto& outcome = map.emplace(index, entry);
+
+    if (!outcome.second)
     {
       ++m_countRejected;
-      saveRejectedRow(E_REGEX);
-      continue;
+      rejects.addFields(E_REPETITION, rowOffset + row.row, row.fields);
+      return;
     }
 
-    static bool relaxIndexChecks = RuntimeConfig::GetInstance().getRelaxIndexChecks();
+    renderEntry(index, *outcome.first);
 
-    if (level > 3L ||
-        (level == 0L && (mr[1].matched || mr[2].matched)) ||
-        (level == 1L && (!mr[1].matched || mr[2].matched)) ||
-        (level >= 2L && (!mr[1].matched || (!mr[2].matched && !relaxIndexChecks))))
+    if constexpr (g_skipLocalitiesBelowStateOrProvince == true)
     {
-      ++m_countRejected;
-      saveRejectedRow(E_MISMATCH);
-      continue;
+      hashEntry({ index, countryName, stateName }, row.level);
+    }
+    else
+    {
+      hashEntry({ index, countryName, stateName, row.locality() }, row.level);
     }
+  };
 
-    const auto& countryName = rowReader[m_indices[1]];
-    const auto& stateName = rowReader[m_indices[2]];
+  cout << APP_TITLE" - processing index" << endl;
+
+  // The chunks keep their addresses while the threads validate them
+  deque<IndexChunk> chunks;
+  string_view block;
 
-    if (!relaxIndexChecks && mr[1].matched == stateName.empty())
+  while (g_SIGINT == 0 && m_pInSource->getBlock(s_chunkSize, block))
+  {
+    IndexChunk& chunk = chunks.emplace_back();
+
+    if (m_pInSource->is_stable())
     {
-      // Reject rows with state/province data and index asserting absense of this data
-      // Reject rows with missing state/province data and index asserting presense of this data
-      ++m_countRejected;
-      saveRejectedRow(E_DATA);
-      continue;     
+      chunk.data = block;
     }
-
-    if (countryName.length() < s_minCountryNameLen ||
-        (!stateName.empty() && stateName.length() < s_minStateNameLen))
+    else
     {
-      ++m_countRejected;
-      saveRejectedRow(E_LENGTH);
-      continue;
+      chunk.storage.assign(block);
+      chunk.data = chunk.storage;
     }
+  }
 
-    if constexpr (g_skipLocalitiesBelowStateOrProvince == true)
+  // The calling thread validates the chunks along with the other threads
+  unsigned threadCount = RuntimeConfig::GetInstance().getProcessingThreads();
+
+  if (threadCount == 0)
+  {
+    threadCount = max(thread::hardware_concurrency(), 1u);
+  }
+
+  atomic<size_t> next(0);
+  vector<thread> threads;
+
+  auto validate = [this, &chunks, &next]() {
+    for (size_t i = next++; i < chunks.size(); i = next++)
     {
-      if (mr[2].matched)
-      {
-        ++m_countFiltered;
-      }
-      else
-      {
-        const auto& outcome = m_map.emplace(make_pair(index, make_tuple(countryName, stateName)));
+      validate_chunk(chunks[i]);
+    }
+  };
 
-        if (!outcome.second)
-        {
-          ++m_countRejected;
-          saveRejectedRow(E_REPETITION);
-          continue;
-        }
-      }
+  for (size_t i = 1; i < min<size_t>(threadCount, chunks.size()); ++i)
+  {
+    threads.emplace_back(validate);
+  }
+
+  validate();
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
 
-      continue;
+  // The validated rows are inserted in the order of the file, so that the
+  // first occurrence of a geoindex is kept and the repetitions are rejected
+  // as by a single thread. The rejects are merged in the order of the rows.
+  size_t rowCount = 0;
+
+  for (const auto& chunk : chunks)
+  {
+    if (chunk.pException)
+    {
+      rethrow_exception(chunk.pException);
     }
-    else
-    { // Check locality data: both subregion2_name and locality_name
-      const auto& subregion2_name = rowReader[m_indices[3]];
-      const auto& locality_name = rowReader[m_indices[4]];
-      const auto& localityName = level == 2L? subregion2_name : locality_name;
-
-      if ((!relaxIndexChecks && mr[2].matched == localityName.empty()) ||
-          (level == 2L && !locality_name.empty()) ||
-          (level == 3L && !relaxIndexChecks && !subregion2_name.empty()))
+
+    auto pRow = chunk.rows.cbegin();
+
+    auto insertRows = [&chunk, &pRow, &insertRow, rowCount](size_t end) {
+      for (; pRow != chunk.rows.cend() && pRow->row < end; ++pRow)
       {
-        // Reject rows with locality data and index asserting absense of this data
-        // Reject rows with missing locality data and index asserting presense of this data
-        // Reject rows with inconsistent locality data
-        ++m_countRejected;
-        saveRejectedRow(E_LOCALITY);
-        continue;
+        insertRow(*pRow, rowCount);
       }
+    };
 
-      if (!localityName.empty() && localityName.length() < s_minLocalityNameLen)
-      {
-        const bool bFound = s_shortLocalities.find(localityName) != s_shortLocalities.end();
+    chunk.rejects.forEach([&rejects, &insertRows, rowCount](unsigned reason, size_t row, string_view data) {
+      insertRows(row);
+      rejects.add(reason, rowCount + row, data);
+    });
 
-        if (!bFound)
-        {
-          ++m_countRejected;
-          saveRejectedRow(E_LOCALITY_LENGTH);
-          continue;
-        }
-      }
+    insertRows(chunk.countRows);
+    rowCount += chunk.countRows;
+    m_countRejected += chunk.countRejected;
+    m_countFiltered += chunk.countFiltered;
+  }
 
-      const auto& outcome = m_map.emplace(make_pair(index, make_tuple(countryName, stateName, localityName, level)));
+  // The end of the input has always been counted as a row
+  if (!g_SIGINT)
+  {
+    ++rowCount;
+  }
 
-      if (!outcome.second)
-      {
-        ++m_countRejected;
-        saveRejectedRow(E_REPETITION);
-        continue;
-      }
-    }
+  // The dictionary entries refer to the strings of the map
+  vector<pair<string_view, DictionarySnapshot::Entry>> entries;
+  entries.reserve(map.size());
 
-    if (rowCount % s_yieldFrequency == 0)
-    {
-      this_thread::yield();
-    }
+  for (const auto& entry : map)
+  {
+    entries.push_back({ entry.key, entry.value });
   }
 
+  DictionarySnapshot::Stats stats;
+  stats.rows = rowCount;
+  stats.rejected = m_countRejected;
+  stats.filtered = m_countFiltered;
+  stats.fingerprint = m_fingerprint = hasher.value();
+  m_dictionary.build(key, entries, stats, rejects);
+
+  m_rejectWriter.submit(rejects);
+  m_rejectWriter.flush();
+
   if (!check_streams())
   {
     assert(false);
@@ -285,38 +327,176 @@ bool CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::build_dictionary()
 template <
   size_t InputFieldCount,
   size_t OutputFieldCount>
-auto CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::process_internal(const wstring& wField) const -> typename Base::OutputFields
+void CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::validate_chunk(IndexChunk& chunk) const noexcept
 {
-  assert(!wField.empty());
+  try
+  {
+    CsvRowReader<InputFieldCount> rowReader(m_indices);
+    MemoryInputSource source(chunk.data);
+    const bool relaxIndexChecks = RuntimeConfig::GetInstance().getRelaxIndexChecks();
+
+    auto saveRejectedRow = [&chunk, &rowReader](E_REJECTION_REASON reason = E_UNSPECIFIED) {
+        chunk.rejects.addFields(reason, chunk.countRows, rowReader.getReadonlyRow());
+    };
+
+    for (; g_SIGINT == 0; ++chunk.countRows)
+    {
+      const auto row = rowReader.readRow(source);
+
+      if (!row)
+      {
+        if (row.error() == CsvRowReader<InputFieldCount>::E_END_OF_INPUT)
+          break;
+
+        ++chunk.countRejected;
+        chunk.rejects.add(E_CSV, chunk.countRows, rowReader.getRow());
+        continue;
+      }
+
+      const auto aggLevel = rowReader[m_indices.back()];
+      unsigned long level = 0L;
+
+      if (from_chars(aggLevel.data(), aggLevel.data() + aggLevel.size(), level).ec != errc())
+      {
+        ++chunk.countRejected;
+        saveRejectedRow(E_AGG_LEVEL);
+        continue;
+      }
+
+      const auto index = rowReader[m_indices.front()];
+      const auto mr = utility::matchIndex(index);
+      if (!mr.matched)
+      {
+        ++chunk.countRejected;
+        saveRejectedRow(E_REGEX);
+        continue;
+      }
+
+      if (level > 3L ||
+          (level == 0L && (mr.state || mr.locality)) ||
+          (level == 1L && (!mr.state || mr.locality)) ||
+          (level >= 2L && (!mr.state || (!mr.locality && !relaxIndexChecks))))
+      {
+        ++chunk.countRejected;
+        saveRejectedRow(E_MISMATCH);
+        continue;
+      }
+
+      const auto countryName = rowReader[m_indices[1]];
+      const auto stateName = rowReader[m_indices[2]];
+
+      if (!relaxIndexChecks && mr.state == stateName.empty())
+      {
+        // Reject rows with state/province data and index asserting absense of this data
+        // Reject rows with missing state/province data and index asserting presense of this data
+        ++chunk.countRejected;
+        saveRejectedRow(E_DATA);
+        continue;     
+      }
+
+      if (utility::utf8Length(countryName) < s_minCountryNameLen ||
+          (!stateName.empty() && utility::utf8Length(stateName) < s_minStateNameLen))
+      {
+        ++chunk.countRejected;
+        saveRejectedRow(E_LENGTH);
+        continue;
+      }
 
-  const auto it = m_map.find(wField);
+      if constexpr (g_skipLocalitiesBelowStateOrProvince == true)
+      {
+        if (mr.locality)
+        {
+          ++chunk.countFiltered;
+        }
+        else
+        {
+          chunk.rows.push_back({ chunk.countRows, rowReader.getReadonlyRow(), level });
+        }
 
-  if (it == m_map.end())
+        continue;
+      }
+      else
+      { // Check locality data: both subregion2_name and locality_name
+        const auto subregion2_name = rowReader[m_indices[3]];
+        const auto locality_name = rowReader[m_indices[4]];
+        const auto localityName = level == 2L? subregion2_name : locality_name;
+
+        if ((!relaxIndexChecks && mr.locality == localityName.empty()) ||
+            (level == 2L && !locality_name.empty()) ||
+            (level == 3L && !relaxIndexChecks && !subregion2_name.empty()))
+        {
+          // Reject rows with locality data and index asserting absense of this data
+          // Reject rows with missing locality data and index asserting presense of this data
+          // Reject rows with inconsistent locality data
+          ++chunk.countRejected;
+          saveRejectedRow(E_LOCALITY);
+          continue;
+        }
+
+        if (!localityName.empty() && utility::utf8Length(localityName) < s_minLocalityNameLen)
+        {
+          const bool bFound = s_shortLocalities.find(localityName) != s_shortLocalities.end();
+
+          if (!bFound)
+          {
+            ++chunk.countRejected;
+            saveRejectedRow(E_LOCALITY_LENGTH);
+            continue;
+          }
+        }
+
+        chunk.rows.push_back({ chunk.countRows, rowReader.getReadonlyRow(), level });
+      }
+    }
+  }
+  catch (...)
   {
-    string msg("lookup failed: index \'");
-    const string field(wField.begin(), wField.end());
-    const string notFound("\' not found");
-    msg += field;
-    msg += notFound;
-    utility::throw_exception<invalid_argument>(msg.c_str());
+    chunk.pException = current_exception();
   }
+}
 
-  if constexpr (g_skipLocalitiesBelowStateOrProvince == true)
+template <
+  size_t InputFieldCount,
+  size_t OutputFieldCount>
+bool CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::load_dictionary(const string& snapshotFile, const DictionarySnapshot::Key& key)
+{
+  if (!m_dictionary.load(snapshotFile, key, s_rejectReasons.size()))
   {
-    const tuple<wstring,wstring>& tpl = it -> second;
-    const auto& [country, state] = tpl;
-
-    typename Base::OutputFields ret{wField, country, state, (state.empty()? L"0" : L"1")};
-    return ret;
+    return false;
   }
-  else
+
+  cout << APP_TITLE" - processing index" << endl;
+  cout << APP_TITLE" - loaded index snapshot" << endl;
+
+  const auto stats = m_dictionary.getStats();
+  m_countRejected = stats.rejected;
+  m_countFiltered = stats.filtered;
+  m_fingerprint = stats.fingerprint;
+
+  // Reproduce the reject file
+  RejectBatch rejects;
+  m_dictionary.getRejects(rejects);
+  m_rejectWriter.submit(rejects);
+  m_rejectWriter.flush();
+
+  if (!check_streams())
   {
-    const tuple<wstring,wstring,wstring,unsigned long>& tpl = it -> second;
-    const auto& [country, state, locality, level] = tpl;
-    const auto aggLevel = to_wstring(level);
-    typename Base::OutputFields ret{wField, country, state, locality, aggLevel};
-    return ret;
+    assert(false);
+    utility::throw_exception<runtime_error>("I/O error during index processing");
   }
+
+  cout << APP_TITLE" - index processing finished" << endl;
+  cout << APP_TITLE" - processed " << stats.rows << " index rows" << endl;
+  return true;
+}
+
+template <
+  size_t InputFieldCount,
+  size_t OutputFieldCount>
+auto CsvProcessorGoogle<InputFieldCount, OutputFieldCount>::process_internal(string_view field) const -> typename Base::Result
+{
+  assert(!field.empty());
+  return processField(field);
 }
 
 template class CsvProcessorGoogle<
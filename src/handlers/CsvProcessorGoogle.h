@@ -1,58 +1,131 @@
 /*
   Implementation of the CsvProcessor interface for
   Google COVID-19 Open Data repository.
+  The validated index dictionary is saved to a snapshot file and loaded
+  from it by the subsequent runs as long as the index file and the
+  settings affecting the dictionary do not change.
+  The field is processed by the inline processField() when CsvFile is
+  instantiated with this class, otherwise through the virtual interface.
 */
 #pragma once
 
-#include <regex>
-#include <fstream>
-#include <unordered_map>
-#include <type_traits>
+#include <array>
+#include <vector>
 #include <set>
+#include <exception>
 
 #include "../config/BuildConfig.h"
 #include "CsvProcessor.h"
 #include "../utility.h"
+#include "../FlatStringMap.h"
+#include "../io/InputSource.h"
+#include "../io/RejectWriter.h"
+#include "../io/DictionarySnapshot.h"
 
 template <
   std::size_t InputFieldCount = CsvFieldCounts::s_indexGoogle,
   std::size_t OutputFieldCount = CsvFieldCounts::s_processingGoogle>
-class CsvProcessorGoogle : public CsvProcessor<InputFieldCount, OutputFieldCount>
+class CsvProcessorGoogle final : public CsvProcessor<InputFieldCount, OutputFieldCount>
 {
 public:
 
   typedef CsvProcessor<InputFieldCount, OutputFieldCount> Base;
-  typedef std::conditional<
-    g_skipLocalitiesBelowStateOrProvince == true,
-    // key: index, value: tuple<country name, state name>
-    std::unordered_map<std::wstring, std::tuple<std::wstring,std::wstring>>,
-    // key: index, value: tuple<country name, state name, locality_name, aggregation_level>
-    // Need aggregation level otherwise it's not clear if the 3rd tuple's string is
-    // subregion2_name (L2) or locality_name (L3)
-    std::unordered_map<std::wstring, std::tuple<std::wstring,std::wstring,std::wstring,unsigned long>>
-  >::type LookupMap;
+  // key: index, value: country name, state name, locality name (subregion2_name
+  // for L2, locality_name for L3, empty if localities are skipped) and
+  // aggregation level along with the output fragment. The strings of the
+  // entries are stored in the map arena.
+  typedef FlatStringMap<DictionarySnapshot::Entry> LookupMap;
 
   CsvProcessorGoogle(const std::string& inFile, typename Base::InputFields&& indices);
   ~CsvProcessorGoogle() = default;
 
+  // Hides CsvProcessor::processField(), see CsvFile
+  typename Base::Result processField(std::string_view field) const
+  {
+    DictionarySnapshot::Entry entry;
+
+    if (!m_dictionary.find(field, entry))
+    {
+      return utility::unexpected(Base::E_NOT_FOUND);
+    }
+
+    return entry.fragment;
+  }
+
 protected:
   using Base::m_indices;
   using Base::m_countRejected;
   using Base::m_countFiltered;
+  using Base::m_fingerprint;
+  // A row of the index file that has passed the validation. The fields
+  // refer to the data of the chunk and are in the order of m_indices.
+  struct IndexRow
+  {
+    // Position of the row in the chunk
+    std::size_t row;
+    std::array<std::string_view, InputFieldCount> fields;
+    unsigned long level;
+
+    std::string_view index() const { return fields[0]; }
+    std::string_view country() const { return fields[1]; }
+    std::string_view state() const { return fields[2]; }
+    // subregion2_name for L2, locality_name for L3
+    std::string_view locality() const { return level == 2L ? fields[3] : fields[4]; }
+  };
+
+  // A block of lines of the index file validated by a thread. The rows and
+  // the rejects are numbered from the start of the chunk.
+  struct IndexChunk
+  {
+    std::string_view data;
+    // Copy of the data unless the input source keeps it valid
+    std::string storage;
+    std::vector<IndexRow> rows;
+    RejectBatch rejects;
+    unsigned countRows = 0;
+    unsigned countRejected = 0;
+    unsigned countFiltered = 0;
+    // Set if the validation has been stopped by an unexpected exception
+    std::exception_ptr pException;
+  };
+
   bool check_streams() const;
-  bool build_dictionary() noexcept(false);
+  // The chunks of the index file are validated in parallel and the rows are
+  // inserted into the dictionary in the order of the file
+  bool build_dictionary(const DictionarySnapshot::Key& key) noexcept(false);
+  void validate_chunk(IndexChunk& chunk) const noexcept;
+  // Returns false if the snapshot does not exist or is out of date
+  bool load_dictionary(const std::string& snapshotFile, const DictionarySnapshot::Key& key) noexcept(false);
+
+  DictionarySnapshot m_dictionary;
+  std::unique_ptr<InputSource> m_pInSource;
+  RejectWriter m_rejectWriter;
 
-  LookupMap m_map;
-  std::wifstream m_inStream;
-  std::wofstream m_rejectStream;
+  typedef enum {
+                  E_UNSPECIFIED,
+                  E_REPETITION,
+                  E_AGG_LEVEL,
+                  E_REGEX,
+                  E_MISMATCH,
+                  E_DATA,
+                  E_LENGTH,
+                  E_LOCALITY,
+                  E_LOCALITY_LENGTH,
+                  E_CSV
+                } E_REJECTION_REASON;
+  // Indexed by E_REJECTION_REASON
+  static const std::vector<RejectWriter::Reason> s_rejectReasons;
 
-  static const int s_yieldFrequency = 100;
+  // Approximate size of a chunk of the index file in bytes
+  static const std::size_t s_chunkSize = 256 << 10;
   static const unsigned s_minCountryNameLen = 4;
   static const unsigned s_minStateNameLen = 3;
   static const unsigned s_minLocalityNameLen = 3;
   // set of localities that have names shorter than the above const
-  static const std::set<std::wstring> s_shortLocalities;
+  static const std::set<std::string, std::less<>> s_shortLocalities;
+  // aggregation levels rendered as output fields
+  static const std::array<std::string_view, 4> s_aggLevels;
   
 private:
-  typename Base::OutputFields process_internal(const std::wstring& field) const noexcept(false) override;
+  typename Base::Result process_internal(std::string_view field) const override;
 };
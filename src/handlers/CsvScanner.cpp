@@ -4,7 +4,7 @@
 
 using namespace std;
 
-CsvScanner::CsvScanner(unsigned maxIndex) : m_maxIndex(maxIndex)
+CsvScanner::CsvScanner(unsigned maxIndex) : m_maxIndex(maxIndex), m_fingerprint(0)
 {
 }
 
@@ -24,4 +24,10 @@ CsvScanner::E_RESULT CsvScanner::scan(Callback& callback)
 {
   auto ret = scan_internal(callback);
   return ret;
+}
+
+unique_ptr<CsvScanner> CsvScanner::clone() const
+{
+  auto ret = unique_ptr<CsvScanner>(clone_internal());
+  return ret;
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 /*
   Handler used by CsvFile to scan a CSV record and decide if the record (being
   a collection of the extracted CSV fields) needs to be processed further or
-  rejected or filtered out.
+  rejected or filtered out. The rows can be scanned one at a time or in
+  batches, see RowBatch.
 */
 #pragma once
 
+#include <memory>
+#include <cstdint>
 #include <functional>
+#include <string_view>
+#include "../RowBatch.h"
 
 /*
   Defines non-virtual interface used for data validation
@@ -13,22 +18,70 @@
 class CsvScanner : public utility::Counter
 {
 public:
-  typedef std::function<const std::wstring&(unsigned)> Callback;
+  // Returns the content of the CSV field with the given index
+  typedef std::function<std::string_view(unsigned)> Callback;
   typedef enum { E_ACCEPT, E_FILTER, E_REJECT } E_RESULT;
 
+  // Outcome of scanning a batch of rows, bit N stands for row N of the batch.
+  // The incorrectly quoted rows belong to none of the masks.
+  struct BatchResult
+  {
+    batch::Mask accept = 0;
+    batch::Mask filter = 0;
+    batch::Mask reject = 0;
+  };
+
   CsvScanner(unsigned maxIndex);
   ~CsvScanner();
 
   // Public non-virtual interface
   E_RESULT scan(Callback& callback);
+  // Scans a row whose fields are returned by field(index). The classes
+  // implementing the interface hide this method with an inline one that is
+  // called directly by CsvFile instantiated with the class.
+  template <typename Field>
+  E_RESULT scanRow(const Field& field)
+  {
+    Callback callback(field);
+    return scan(callback);
+  }
+  // Scans the valid rows of the batch one at a time. The classes
+  // implementing the interface may hide this method with one that makes
+  // the decisions for the whole batch at once.
+  template <std::size_t FieldCount>
+  BatchResult scanBatch(const RowBatch<FieldCount>& batch)
+  {
+    BatchResult ret;
+
+    for (std::size_t i = 0; i < batch.size(); ++i)
+    {
+      const batch::Mask bit = batch::Mask(1) << i;
+
+      if (batch.validRows() & bit)
+      {
+        auto field = [&batch, i](unsigned index) { return batch.field(index, i); };
+        const E_RESULT result = scanRow(field);
+        (result == E_ACCEPT ? ret.accept : result == E_FILTER ? ret.filter : ret.reject) |= bit;
+      }
+    }
+
+    return ret;
+  }
+  // Creates a scanner of the same type with zero counts, e.g. to be used by
+  // another thread
+  std::unique_ptr<CsvScanner> clone() const;
+  // Changes whenever the scanning decisions change, e.g. due to the settings
+  std::uint64_t getFingerprint() const { return m_fingerprint; }
 
 protected:
   const unsigned m_maxIndex;
+  std::uint64_t m_fingerprint;
 
 private:
   // Private virtual interface meant to hide the existence of derived classes
   // (implementing this interface) from external callers that use CsvScanner.
   virtual E_RESULT scan_internal(Callback& callback) = 0;
+  virtual CsvScanner* clone_internal() const = 0;
   // It's ok for a virtual method to be private since it doesn't need to be
   // called by the derived class method. And there is no need to call it
   // because we chose not to provide a body so there is no code to reuse
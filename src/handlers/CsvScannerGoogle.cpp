@@ -6,75 +6,73 @@
 
 using namespace std;
 
-const wregex CsvScannerGoogle::s_regexDate{L"^20[1-2][0-9]-\\d{2}-\\d{2}$"};
-const wregex CsvScannerGoogle::s_regexUkNuts{L"^GB_UK[A-Z]$"};
-
-CsvScannerGoogle::CsvScannerGoogle(unsigned maxIndex) : CsvScanner(maxIndex)
+CsvScannerGoogle::CsvScannerGoogle(unsigned maxIndex) : CsvScanner(maxIndex),
+  m_decision{ E_ACCEPT, false, false }, m_pLastDecision(nullptr),
+  m_today(utility::parseDate(utility::getGmtDate())),
+  m_bFilterUkNuts(RuntimeConfig::GetInstance().getFilterUkNuts()),
+  m_bFilterAuData(RuntimeConfig::GetInstance().getFilterAuData())
 {
+  const auto& cfg = RuntimeConfig::GetInstance();
+  utility::Hasher hasher;
+  hasher.update(g_skipLocalitiesBelowStateOrProvince);
+  hasher.update(cfg.getFilterUkNuts());
+  hasher.update(cfg.getFilterAuData());
+  hasher.update(uint64_t(s_firstDate));
+  hasher.update(uint64_t(s_lastDate));
+
+  // The filtering of Australian data depends on the current date
+  if (cfg.getFilterAuData())
+  {
+    hasher.update(string_view(utility::getGmtDate()));
+  }
+
+  m_fingerprint = hasher.value();
 }
 
 CsvScanner::E_RESULT CsvScannerGoogle::scan_internal(CsvScanner::Callback& callback)
 {
-  CsvScanner::E_RESULT ret = E_ACCEPT;
-
-  // Reject rows with invalid index
-  // Depending on a build, filter rows with index below state/province level
-  wsmatch mr;
-  bool bMatch = regex_match(callback(1), mr, utility::g_regexIndex);
+  return scanRow(callback);
+}
 
-  if (!bMatch)
-  {
-    ++m_countRejected;
-    ret = E_REJECT;
-  }
-  else if (g_skipLocalitiesBelowStateOrProvince)
-  {
-    if (mr[2].matched)
-    {
-      ++m_countFiltered;
-      ret = E_FILTER;
-    }
-  }
+auto CsvScannerGoogle::find_decision(string_view index) -> const IndexDecision&
+{
+  m_lastIndex.assign(index);
+  m_pLastDecision = m_decisions.find(index);
 
-  if (ret != E_ACCEPT)
+  if (m_pLastDecision)
   {
-    return ret;
+    return *m_pLastDecision;
   }
 
-  bool bConfirmed = callback(6).empty();
-  bool bRecovered = callback(7).empty();
-  bool bDeaths = callback(8).empty();
-  static bool filterUkNuts = RuntimeConfig::GetInstance().getFilterUkNuts();
-  static bool filterAuData = RuntimeConfig::GetInstance().getFilterAuData();
+  // Reject rows with invalid index
+  // Depending on a build, filter rows with index below state/province level
+  const auto mr = utility::matchIndex(index);
+  IndexDecision decision{ E_ACCEPT, index.rfind("AU", 0) == 0, utility::isUkNuts(index) };
 
-  // Filter out the rows without all the three cumulative epidemiology metrics
-  if (bConfirmed && bRecovered && bDeaths)
+  if (!mr.matched)
   {
-    ++m_countFiltered;
-    ret = E_FILTER;
+    decision.result = E_REJECT;
   }
-  else if (filterAuData && bRecovered && bDeaths &&
-    callback(1).rfind(L"AU", 0) == 0 && callback(0) == utility::getGmtDate())
+  else if (g_skipLocalitiesBelowStateOrProvince && mr.locality)
   {
-    // Additionally filter out the rows for Australia today's data if
-    // the last two metrics are missing regardless of the first metric
-    // (cumulative confirmed case count) being present or not.
-    ++m_countFiltered;
-    ret = E_FILTER;
+    decision.result = E_FILTER;
   }
-  else if (filterUkNuts && regex_match(callback(1).c_str(), CsvScannerGoogle::s_regexUkNuts))
+
+  // The emplacement may move the other entries but not the last one
+  if (m_decisions.size() < s_maxDecisions)
   {
-    // Filter out UK NUTS regions otherwise 'calculated total' figures
-    // get distorted
-    ++m_countFiltered;
-    ret = E_FILTER;
+    m_pLastDecision = m_decisions.emplace(index, decision).first;
   }
-  else if (!regex_match(callback(0).c_str(), CsvScannerGoogle::s_regexDate))
+  else
   {
-    // Reject rows with invalid date
-    ++m_countRejected;
-    ret = E_REJECT;
+    m_decision = decision;
+    m_pLastDecision = &m_decision;
   }
 
-  return ret;
+  return *m_pLastDecision;
+}
+
+CsvScanner* CsvScannerGoogle::clone_internal() const
+{
+  return new CsvScannerGoogle(m_maxIndex);
 }
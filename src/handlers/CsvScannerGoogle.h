@@ -1,24 +1,205 @@
 /*
   Implementation of the CsvScanner interface for
   Google COVID-19 Open Data repository.
+  The decisions that depend on the geoindex only are cached per geoindex,
+  so a row with an already seen geoindex costs a single hash lookup
+  instead of the geoindex validation. The rows that follow a row with the
+  same geoindex reuse its decisions without the lookup.
+  The row is scanned by the inline scanRow() when CsvFile is instantiated
+  with this class, otherwise through the virtual interface.
+  scanBatch() evaluates the checks of the epidemiology metrics and of the
+  dates over a whole batch of rows. Each check yields a mask of the rows
+  that fail it and the masks are combined in the order the checks are made
+  by scanRow(), so that both methods make the same decisions.
 */
 #pragma once
 
-#include <regex>
+#include <string>
+#include <string_view>
+#include "../utility.h"
+#include "../config/BuildConfig.h"
 #include "CsvScanner.h"
+#include "../FlatStringMap.h"
 
-class CsvScannerGoogle : public CsvScanner
+class CsvScannerGoogle final : public CsvScanner
 {
 public:
 
   CsvScannerGoogle(unsigned maxIndex);
   ~CsvScannerGoogle() = default;
-  
+
+  // Hides CsvScanner::scanRow(), see CsvFile
+  template <typename Field>
+  E_RESULT scanRow(const Field& field);
+  // Hides CsvScanner::scanBatch(), see CsvFile
+  template <std::size_t FieldCount>
+  BatchResult scanBatch(const RowBatch<FieldCount>& batch);
+
 private:
   CsvScanner::E_RESULT scan_internal(CsvScanner::Callback& callback) override;
+  CsvScanner* clone_internal() const override;
+
+  struct IndexDecision
+  {
+    // Outcome of the geoindex validation and the filtering of localities
+    CsvScanner::E_RESULT result;
+    bool bAustralia;
+    bool bUkNuts;
+  };
+
+  const IndexDecision& getDecision(std::string_view index)
+  {
+    if (m_pLastDecision && index == m_lastIndex)
+    {
+      return *m_pLastDecision;
+    }
+
+    return find_decision(index);
+  }
+
+  const IndexDecision& find_decision(std::string_view index);
+
+  // Each scanner, i.e. each thread, has its own cache
+  FlatStringMap<IndexDecision> m_decisions;
+  // Used once the cache is full
+  IndexDecision m_decision;
+  // The geoindex of the preceding row and its decisions
+  std::string m_lastIndex;
+  const IndexDecision* m_pLastDecision;
+  // The current GMT date as returned by utility::parseDate()
+  const int m_today;
+  const bool m_bFilterUkNuts;
+  const bool m_bFilterAuData;
 
-  // Regex to check dates
-  static const std::wregex s_regexDate;
-  // Regex to find UK NUTS regions
-  static const std::wregex s_regexUkNuts;
+  // The valid dates match ^20[1-2][0-9]-\d{2}-\d{2}$ and exist
+  static constexpr int s_firstDate = utility::parseDate("2010-01-01");
+  static constexpr int s_lastDate = utility::parseDate("2029-12-31");
+
+  // Bounds the memory used by the cache if the geoindexes are mostly unique
+  static const std::size_t s_maxDecisions = 1 << 16;
 };
+
+template <typename Field>
+CsvScanner::E_RESULT CsvScannerGoogle::scanRow(const Field& field)
+{
+  const IndexDecision& decision = getDecision(field(1));
+  CsvScanner::E_RESULT ret = decision.result;
+
+  if (ret != E_ACCEPT)
+  {
+    if (ret == E_REJECT)
+    {
+      ++m_countRejected;
+    }
+    else
+    {
+      ++m_countFiltered;
+    }
+
+    return ret;
+  }
+
+  bool bConfirmed = field(6).empty();
+  bool bRecovered = field(7).empty();
+  bool bDeaths = field(8).empty();
+  const int date = utility::parseDate(field(0));
+
+  // Filter out the rows without all the three cumulative epidemiology metrics
+  if (bConfirmed && bRecovered && bDeaths)
+  {
+    ++m_countFiltered;
+    ret = E_FILTER;
+  }
+  else if (m_bFilterAuData && bRecovered && bDeaths &&
+    decision.bAustralia && date == m_today && date != utility::g_invalidDate)
+  {
+    // Additionally filter out the rows for Australia today's data if
+    // the last two metrics are missing regardless of the first metric
+    // (cumulative confirmed case count) being present or not.
+    ++m_countFiltered;
+    ret = E_FILTER;
+  }
+  else if (m_bFilterUkNuts && decision.bUkNuts)
+  {
+    // Filter out UK NUTS regions otherwise 'calculated total' figures
+    // get distorted
+    ++m_countFiltered;
+    ret = E_FILTER;
+  }
+  else if (date < s_firstDate || date > s_lastDate)
+  {
+    // Reject rows with invalid date
+    ++m_countRejected;
+    ret = E_REJECT;
+  }
+
+  return ret;
+}
+
+template <std::size_t FieldCount>
+CsvScanner::BatchResult CsvScannerGoogle::scanBatch(const RowBatch<FieldCount>& batch)
+{
+  typedef batch::Mask Mask;
+  const unsigned dateField = batch.ordinal(0);
+  const unsigned indexField = batch.ordinal(1);
+  const Mask valid = batch.validRows();
+  Mask rejected = 0;
+  Mask filtered = 0;
+  Mask australia = 0;
+  Mask ukNuts = 0;
+  batch::Values dates;
+
+  // The geoindex decisions and the dates are obtained row by row, the
+  // unused part of the batch gets invalid dates
+  for (std::size_t i = 0; i < batch.s_capacity; ++i)
+  {
+    const Mask bit = Mask(1) << i;
+
+    if ((valid & bit) == 0)
+    {
+      dates[i] = utility::g_invalidDate;
+      continue;
+    }
+
+    const IndexDecision& decision = getDecision(batch.getField(indexField, i));
+    rejected |= decision.result == E_REJECT ? bit : 0;
+    filtered |= decision.result == E_FILTER ? bit : 0;
+    australia |= decision.bAustralia ? bit : 0;
+    ukNuts |= decision.bUkNuts ? bit : 0;
+    dates[i] = utility::parseDate(batch.getField(dateField, i));
+  }
+
+  // The rows passed by the geoindex checks
+  Mask remaining = valid & ~rejected & ~filtered;
+  const Mask noRecovered = batch.emptyRows(batch.ordinal(7));
+  const Mask noDeaths = batch.emptyRows(batch.ordinal(8));
+
+  // Filter out the rows without all the three cumulative epidemiology metrics
+  Mask filter = remaining & batch.emptyRows(batch.ordinal(6)) & noRecovered & noDeaths;
+  remaining &= ~filter;
+
+  if (m_bFilterAuData && m_today != utility::g_invalidDate)
+  {
+    // Australia today's data missing the last two metrics
+    const Mask auToday = remaining & australia & noRecovered & noDeaths & batch::isEqual(dates, m_today);
+    filter |= auToday;
+    remaining &= ~auToday;
+  }
+
+  if (m_bFilterUkNuts)
+  {
+    filter |= remaining & ukNuts;
+    remaining &= ~ukNuts;
+  }
+
+  // Reject rows with invalid date
+  const Mask validDate = batch::isInRange(dates, s_firstDate, s_lastDate);
+
+  BatchResult ret;
+  ret.accept = remaining & validDate;
+  ret.filter = filtered | filter;
+  ret.reject = rejected | (remaining & ~validDate);
+  m_countFiltered += __builtin_popcountll(ret.filter);
+  m_countRejected += __builtin_popcountll(ret.reject);
+  return ret;
+}
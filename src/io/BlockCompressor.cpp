@@ -0,0 +1,166 @@
+#include <algorithm>
+#if CSV_ZLIB
+#include <zlib.h>
+#endif
+#if CSV_ZSTD
+#include <zstd.h>
+#endif
+#include "BlockCompressor.h"
+
+using namespace std;
+
+BlockCompressor::BlockCompressor(E_COMPRESSION compression, unsigned threadCount, Sink sink) :
+  m_compression(compression), m_sink(move(sink)), m_jobs(max(threadCount, 1u) * s_jobsPerThread),
+  m_submitted(0), m_taken(0), m_written(0), m_bStop(false), m_bBad(false)
+{
+  for (unsigned i = 0; i < max(threadCount, 1u); ++i)
+  {
+    m_threads.emplace_back(&BlockCompressor::run, this);
+  }
+}
+
+BlockCompressor::~BlockCompressor()
+{
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_bStop = true;
+  }
+
+  m_jobAvailable.notify_all();
+
+  for (auto& thread : m_threads)
+  {
+    thread.join();
+  }
+}
+
+bool BlockCompressor::submit(string_view data)
+{
+  unique_lock<mutex> lock(m_mutex);
+
+  while (!data.empty())
+  {
+    // Wait for a free job
+    write_jobs(lock, m_jobs.size() - 1);
+
+    Job& job = m_jobs[m_submitted % m_jobs.size()];
+    const size_t size = min(data.size(), s_blockSize);
+    job.input.assign(data.data(), size);
+    job.bDone = false;
+    job.bError = false;
+    ++m_submitted;
+    data.remove_prefix(size);
+    m_jobAvailable.notify_one();
+  }
+
+  // Write the blocks compressed so far without waiting for the others
+  write_jobs(lock, m_jobs.size());
+  return !m_bBad;
+}
+
+bool BlockCompressor::finish()
+{
+  unique_lock<mutex> lock(m_mutex);
+  write_jobs(lock, 0);
+  return !m_bBad;
+}
+
+void BlockCompressor::write_jobs(unique_lock<mutex>& lock, size_t maxPending)
+{
+  while (m_written < m_submitted)
+  {
+    Job& job = m_jobs[m_written % m_jobs.size()];
+
+    if (!job.bDone)
+    {
+      if (m_submitted - m_written <= maxPending)
+      {
+        break;
+      }
+
+      m_jobDone.wait(lock, [&job] { return job.bDone; });
+    }
+
+    // The job is not reused before m_written moves past it
+    lock.unlock();
+    const bool bOk = !m_bBad && !job.bError && m_sink(job.output);
+    lock.lock();
+
+    m_bBad = !bOk;
+    ++m_written;
+  }
+}
+
+void BlockCompressor::run()
+{
+  unique_lock<mutex> lock(m_mutex);
+
+  while (true)
+  {
+    m_jobAvailable.wait(lock, [this] { return m_bStop || m_taken < m_submitted; });
+
+    if (m_taken == m_submitted)
+    {
+      return;
+    }
+
+    Job& job = m_jobs[m_taken++ % m_jobs.size()];
+    lock.unlock();
+    const bool bOk = compress(job.input, job.output);
+    lock.lock();
+
+    job.bError = !bOk;
+    job.bDone = true;
+    m_jobDone.notify_one();
+  }
+}
+
+bool BlockCompressor::compress(string_view input, string& output) const
+{
+  switch (m_compression)
+  {
+#if CSV_ZLIB
+    case Compression::E_GZIP:
+    {
+      z_stream stream = {};
+
+      // A gzip member rather than a zlib stream
+      if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+        return false;
+      }
+
+      output.resize(deflateBound(&stream, input.size()));
+      stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+      stream.avail_in = static_cast<uInt>(input.size());
+      stream.next_out = reinterpret_cast<Bytef*>(output.data());
+      stream.avail_out = static_cast<uInt>(output.size());
+
+      const bool ret = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+      output.resize(stream.total_out);
+      deflateEnd(&stream);
+      return ret;
+    }
+#endif
+#if CSV_ZSTD
+    case Compression::E_ZSTD:
+    {
+      output.resize(ZSTD_compressBound(input.size()));
+      const size_t len = ZSTD_compress(output.data(), output.size(), input.data(), input.size(), ZSTD_CLEVEL_DEFAULT);
+
+      if (ZSTD_isError(len))
+      {
+        return false;
+      }
+
+      output.resize(len);
+      return true;
+    }
+#endif
+    case Compression::E_NONE:
+      output.assign(input.data(), input.size());
+      return true;
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,71 @@
+/*
+  BlockCompressor compresses output data on worker threads in the manner of
+  pigz. The data is split into blocks that are compressed independently of
+  each other, each into a complete gzip member or zstd frame, and the
+  compressed blocks are passed to the sink in the order the data has been
+  submitted. The concatenated members (frames) form a valid gzip (zstd)
+  stream that decompresses into the original data.
+*/
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include "Compression.h"
+
+class BlockCompressor
+{
+public:
+  typedef Compression::E_COMPRESSION E_COMPRESSION;
+  // Writes the compressed data, returns false on failure
+  typedef std::function<bool(std::string_view)> Sink;
+
+  BlockCompressor(E_COMPRESSION compression, unsigned threadCount, Sink sink);
+  ~BlockCompressor();
+  BlockCompressor(const BlockCompressor&) = delete;
+  BlockCompressor& operator=(const BlockCompressor&) = delete;
+
+  // Queues the data for compression and passes the blocks compressed so far
+  // to the sink. Waits if too many blocks are pending. Returns false if the
+  // compression or the sink has failed.
+  bool submit(std::string_view data);
+  // Waits until all the submitted data has been passed to the sink
+  bool finish();
+
+private:
+  struct Job
+  {
+    std::string input;
+    std::string output;
+    bool bDone;
+    bool bError;
+  };
+
+  void run();
+  bool compress(std::string_view input, std::string& output) const;
+  // Passes the compressed blocks to the sink in order, waits for the blocks
+  // still being compressed until at most maxPending remain
+  void write_jobs(std::unique_lock<std::mutex>& lock, std::size_t maxPending);
+
+  const E_COMPRESSION m_compression;
+  Sink m_sink;
+  std::vector<Job> m_jobs;
+  // Sequence numbers of the next job to submit, to compress and to write
+  std::size_t m_submitted;
+  std::size_t m_taken;
+  std::size_t m_written;
+  bool m_bStop;
+  bool m_bBad;
+  std::mutex m_mutex;
+  std::condition_variable m_jobAvailable;
+  std::condition_variable m_jobDone;
+  std::vector<std::thread> m_threads;
+
+  // Larger blocks compress better, smaller ones keep more threads busy
+  static const std::size_t s_blockSize = 1 << 20;
+  static const unsigned s_jobsPerThread = 2;
+};
@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <fstream>
+#include "../config/BuildConfig.h"
+#include "../config/json.hpp"
+#include "Checkpoint.h"
+
+using namespace std;
+namespace nh = nlohmann;
+
+namespace
+{
+  const string versionLiteral("version");
+  const string offsetLiteral("offset");
+  const string prefixHashLiteral("prefixHash");
+  const string fingerprintLiteral("fingerprint");
+  const string rowsLiteral("rows");
+  const string rejectedRowsLiteral("rejectedRows");
+}
+
+bool Checkpoint::load(const string& path)
+{
+  ifstream ifs(path);
+
+  if (!ifs.is_open())
+  {
+    return false;
+  }
+
+  try
+  {
+    nh::json j = nh::json::parse(ifs);
+
+    if (j.at(versionLiteral).get<string>() != STRINGIFY(CSV_VERSION))
+    {
+      return false;
+    }
+
+    offset = j.at(offsetLiteral);
+    prefixHash = j.at(prefixHashLiteral);
+    fingerprint = j.at(fingerprintLiteral);
+    rows = j.at(rowsLiteral);
+    rejectedRows = j.at(rejectedRowsLiteral);
+  }
+  catch (const exception&)
+  {
+    return false;
+  }
+
+  return true;
+}
+
+bool Checkpoint::save(const string& path) const
+{
+  nh::json j;
+  j[versionLiteral] = STRINGIFY(CSV_VERSION);
+  j[offsetLiteral] = offset;
+  j[prefixHashLiteral] = prefixHash;
+  j[fingerprintLiteral] = fingerprint;
+  j[rowsLiteral] = rows;
+  j[rejectedRowsLiteral] = rejectedRows;
+
+  const string tempPath = path + ".tmp";
+  {
+    ofstream ofs(tempPath, ios::trunc);
+    ofs << j.dump(1) << '\n';
+
+    if (!ofs.flush())
+    {
+      return false;
+    }
+  }
+
+  return ::rename(tempPath.c_str(), path.c_str()) == 0;
+}
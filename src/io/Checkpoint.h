@@ -0,0 +1,28 @@
+/*
+  Checkpoint records how much of an append-only input file has been processed
+  so that the next run can process the appended rows only. It is saved as a
+  JSON file next to the output file after a successful run.
+*/
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct Checkpoint
+{
+  // Count of processed bytes, the processed data ends with '\n'
+  std::uint64_t offset = 0;
+  // Hash of the processed data, see utility::Hasher
+  std::uint64_t prefixHash = 0;
+  // Hash of the dictionary and the settings that affect the output
+  std::uint64_t fingerprint = 0;
+  // Counts of the processed and rejected data rows
+  unsigned rows = 0;
+  unsigned rejectedRows = 0;
+
+  // Returns false if the file is missing, was saved by another version of
+  // the program or cannot be parsed
+  bool load(const std::string& path);
+  // Replaces the file atomically
+  bool save(const std::string& path) const;
+};
@@ -0,0 +1,26 @@
+/*
+  The compression formats of the input and output files, shared by
+  DecompressingInputSource and BlockCompressor. The support of a format
+  depends on the build, see CSV_ZLIB and CSV_ZSTD in the makefile.
+*/
+#pragma once
+
+struct Compression
+{
+  typedef enum { E_NONE, E_GZIP, E_ZSTD } E_COMPRESSION;
+
+  static bool isSupported(E_COMPRESSION compression)
+  {
+    switch (compression)
+    {
+      case E_NONE:
+        return true;
+      case E_GZIP:
+        return CSV_ZLIB;
+      case E_ZSTD:
+        return CSV_ZSTD;
+      default:
+        return false;
+    }
+  }
+};
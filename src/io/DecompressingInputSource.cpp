@@ -0,0 +1,315 @@
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if CSV_ZLIB
+#include <zlib.h>
+#endif
+#if CSV_ZSTD
+#include <zstd.h>
+#endif
+#include "DecompressingInputSource.h"
+
+using namespace std;
+
+DecompressingInputSource::DecompressingInputSource(const string& path, E_COMPRESSION compression) :
+  BufferedInputSource(path), m_compression(compression), m_blocks(s_blockCount),
+  m_filled(s_blockCount), m_free(s_blockCount), m_pOutput(nullptr), m_pInput(nullptr),
+  m_inputPos(0), m_bFinished(false), m_bStop(false)
+{
+  if (!m_bOpen)
+  {
+    return;
+  }
+
+  if (!Compression::isSupported(compression))
+  {
+    m_bOpen = false;
+    return;
+  }
+
+  for (auto& block : m_blocks)
+  {
+    block.data.resize(s_decompressedSize);
+    m_free.push(&block);
+  }
+
+  m_thread = thread(&DecompressingInputSource::run, this);
+}
+
+DecompressingInputSource::~DecompressingInputSource()
+{
+  m_bStop = true;
+
+  if (m_thread.joinable())
+  {
+    m_thread.join();
+  }
+}
+
+DecompressingInputSource::E_COMPRESSION DecompressingInputSource::getCompression(const string& path)
+{
+  E_COMPRESSION ret = Compression::E_NONE;
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+  {
+    return ret;
+  }
+
+  struct stat st;
+  unsigned char magic[4];
+
+  // pread() does not consume the data and fails on pipes
+  if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && ::pread(fd, magic, sizeof(magic), 0) == sizeof(magic))
+  {
+    if (magic[0] == 0x1F && magic[1] == 0x8B)
+    {
+      ret = Compression::E_GZIP;
+    }
+    else if (magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+    {
+      ret = Compression::E_ZSTD;
+    }
+  }
+
+  ::close(fd);
+  return ret;
+}
+
+ssize_t DecompressingInputSource::read_data(char* pBuffer, size_t size)
+{
+  while (true)
+  {
+    if (!m_pInput)
+    {
+      if (m_bFinished)
+      {
+        return 0;
+      }
+
+      m_filled.pop(m_pInput);
+      m_inputPos = 0;
+    }
+
+    const size_t available = m_pInput->size - m_inputPos;
+
+    if (available > 0)
+    {
+      const size_t len = min(size, available);
+      ::memcpy(pBuffer, m_pInput->data.data() + m_inputPos, len);
+      m_inputPos += len;
+      return static_cast<ssize_t>(len);
+    }
+
+    // The block has been consumed
+    if (m_pInput->bLast)
+    {
+      m_bFinished = true;
+      const bool bError = m_pInput->bError;
+      m_pInput = nullptr;
+
+      if (bError)
+      {
+        return -1;
+      }
+    }
+    else
+    {
+      m_free.push(m_pInput);
+      m_pInput = nullptr;
+    }
+  }
+}
+
+void DecompressingInputSource::run()
+{
+  m_free.pop(m_pOutput);
+  m_pOutput->size = 0;
+
+  bool bOk = m_compression == Compression::E_GZIP ? decompress_gzip() : decompress_zstd();
+  emit_block(true, !bOk);
+}
+
+bool DecompressingInputSource::emit_block(bool bLast, bool bError)
+{
+  m_pOutput->bLast = bLast;
+  m_pOutput->bError = bError;
+
+  // Wait for the consumer unless the source is being destroyed
+  for (unsigned attempt = 0; !m_filled.tryPush(m_pOutput); ring::wait(attempt))
+  {
+    if (m_bStop)
+    {
+      return false;
+    }
+  }
+
+  if (bLast)
+  {
+    return true;
+  }
+
+  for (unsigned attempt = 0; !m_free.tryPop(m_pOutput); ring::wait(attempt))
+  {
+    if (m_bStop)
+    {
+      return false;
+    }
+  }
+
+  m_pOutput->size = 0;
+  return true;
+}
+
+ssize_t DecompressingInputSource::read_compressed(char* pBuffer, size_t size)
+{
+  return BufferedInputSource::read_data(pBuffer, size);
+}
+
+bool DecompressingInputSource::decompress_gzip()
+{
+#if CSV_ZLIB
+  z_stream stream;
+  ::memset(&stream, 0, sizeof(stream));
+
+  // Accept gzip and zlib headers
+  if (inflateInit2(&stream, 15 + 32) != Z_OK)
+  {
+    return false;
+  }
+
+  vector<char> input(s_compressedSize);
+  bool bOk = true;
+  bool bEof = false;
+  bool bStreamEnd = false;
+  bool bFlushed = true;
+
+  while (!m_bStop)
+  {
+    if (stream.avail_in == 0 && !bEof)
+    {
+      const ssize_t len = read_compressed(input.data(), input.size());
+
+      if (len < 0)
+      {
+        bOk = false;
+        break;
+      }
+
+      bEof = len == 0;
+      stream.next_in = reinterpret_cast<Bytef*>(input.data());
+      stream.avail_in = static_cast<uInt>(len);
+    }
+
+    if (stream.avail_in == 0 && bEof && bFlushed)
+    {
+      // Truncated data if the last member is incomplete
+      bOk = bStreamEnd;
+      break;
+    }
+
+    if (bStreamEnd && stream.avail_in > 0)
+    {
+      // Another gzip member follows
+      inflateReset(&stream);
+      bStreamEnd = false;
+    }
+
+    stream.next_out = reinterpret_cast<Bytef*>(m_pOutput->data.data() + m_pOutput->size);
+    stream.avail_out = static_cast<uInt>(s_decompressedSize - m_pOutput->size);
+
+    const int ret = inflate(&stream, Z_NO_FLUSH);
+    m_pOutput->size = s_decompressedSize - stream.avail_out;
+    bFlushed = stream.avail_out != 0;
+
+    if (ret == Z_STREAM_END)
+    {
+      bStreamEnd = true;
+    }
+    else if (ret != Z_OK && ret != Z_BUF_ERROR)
+    {
+      bOk = false;
+      break;
+    }
+
+    if (!bFlushed && !emit_block())
+    {
+      break;
+    }
+  }
+
+  inflateEnd(&stream);
+  return bOk;
+#else
+  return false;
+#endif
+}
+
+bool DecompressingInputSource::decompress_zstd()
+{
+#if CSV_ZSTD
+  ZSTD_DCtx* pContext = ZSTD_createDCtx();
+
+  if (!pContext)
+  {
+    return false;
+  }
+
+  vector<char> input(s_compressedSize);
+  ZSTD_inBuffer in{ input.data(), 0, 0 };
+  bool bOk = true;
+  bool bEof = false;
+  bool bFlushed = true;
+  // Zero once a frame is completely decoded
+  size_t ret = 0;
+
+  while (!m_bStop)
+  {
+    if (in.pos == in.size && !bEof)
+    {
+      const ssize_t len = read_compressed(input.data(), input.size());
+
+      if (len < 0)
+      {
+        bOk = false;
+        break;
+      }
+
+      bEof = len == 0;
+      in.size = static_cast<size_t>(len);
+      in.pos = 0;
+    }
+
+    if (in.pos == in.size && bEof && bFlushed)
+    {
+      // Truncated data if the last frame is incomplete
+      bOk = ret == 0;
+      break;
+    }
+
+    ZSTD_outBuffer out{ m_pOutput->data.data(), s_decompressedSize, m_pOutput->size };
+    ret = ZSTD_decompressStream(pContext, &out, &in);
+
+    if (ZSTD_isError(ret))
+    {
+      bOk = false;
+      break;
+    }
+
+    m_pOutput->size = out.pos;
+    bFlushed = out.pos < out.size;
+
+    if (!bFlushed && !emit_block())
+    {
+      break;
+    }
+  }
+
+  ZSTD_freeDCtx(pContext);
+  return bOk;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,64 @@
+/*
+  DecompressingInputSource reads a gzip or zstd compressed file. The file is
+  decompressed by a background thread that hands the decompressed blocks
+  over through a ring buffer, so that the decompression overlaps with the
+  parsing of the data. Concatenated gzip members and zstd frames are
+  decompressed one after another as a single stream.
+  The zstd support depends on the build, see CSV_ZSTD in the makefile.
+*/
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "InputSource.h"
+#include "Compression.h"
+#include "../RingBuffer.h"
+
+class DecompressingInputSource : public BufferedInputSource
+{
+public:
+  typedef Compression::E_COMPRESSION E_COMPRESSION;
+
+  DecompressingInputSource(const std::string& path, E_COMPRESSION compression);
+  ~DecompressingInputSource();
+
+  // Detects the compression of a regular file by its magic number
+  static E_COMPRESSION getCompression(const std::string& path);
+
+private:
+  struct Block
+  {
+    std::vector<char> data;
+    std::size_t size;
+    // Set for the last block, along with bError if the decompression failed
+    bool bLast;
+    bool bError;
+  };
+
+  ssize_t read_data(char* pBuffer, std::size_t size) override;
+
+  void run();
+  bool decompress_gzip();
+  bool decompress_zstd();
+  ssize_t read_compressed(char* pBuffer, std::size_t size);
+  // Passes the current block to the consumer and obtains an empty one
+  bool emit_block(bool bLast = false, bool bError = false);
+
+  const E_COMPRESSION m_compression;
+  std::vector<Block> m_blocks;
+  SpscRing<Block*> m_filled;
+  SpscRing<Block*> m_free;
+  // Used by the background thread
+  Block* m_pOutput;
+  // Used by the consumer
+  Block* m_pInput;
+  std::size_t m_inputPos;
+  bool m_bFinished;
+  std::atomic<bool> m_bStop;
+  std::thread m_thread;
+
+  static const std::size_t s_blockCount = 4;
+  static const std::size_t s_decompressedSize = 1 << 20;
+  static const std::size_t s_compressedSize = 256 << 10;
+};
@@ -0,0 +1,335 @@
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include "../utility.h"
+#include "OutputWriter.h"
+#include "DictionarySnapshot.h"
+
+using namespace std;
+
+namespace
+{
+  const char s_magic[8] = { 'C', 'S', 'V', 'D', 'I', 'C', 'T', '\0' };
+  // Incremented whenever the layout changes
+  const uint64_t s_format = 3;
+
+  size_t align(size_t offset)
+  {
+    return (offset + 7) & ~size_t(7);
+  }
+}
+
+// The layout of the snapshot, the offsets are relative to the header
+struct DictionarySnapshot::Header
+{
+  char magic[8];
+  uint64_t format;
+  Key key;
+  uint64_t fingerprint;
+  uint32_t rows;
+  uint32_t rejected;
+  uint32_t filtered;
+  uint32_t entryCount;
+  // Power of two greater than the count of entries
+  uint32_t bucketCount;
+  uint32_t rejectCount;
+  uint64_t bucketsOffset;
+  uint64_t entriesOffset;
+  uint64_t rejectsOffset;
+  uint64_t stringsOffset;
+  uint64_t stringsSize;
+  uint64_t totalSize;
+};
+
+// Refers to a string relative to the strings offset
+struct DictionarySnapshot::Ref
+{
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct DictionarySnapshot::EntryRecord
+{
+  Ref key;
+  Ref country;
+  Ref state;
+  Ref locality;
+  Ref fragment;
+  uint32_t level;
+  // Lower half of the key hash, saves most key comparisons on collisions
+  uint32_t hash;
+};
+
+struct DictionarySnapshot::RejectRecord
+{
+  uint32_t reason;
+  uint32_t row;
+  Ref data;
+};
+
+DictionarySnapshot::DictionarySnapshot()
+{
+  build(Key(), {}, Stats(), RejectBatch());
+}
+
+bool DictionarySnapshot::getKey(const string& indexPath, uint64_t settings, Key& key)
+{
+  struct stat st;
+
+  if (::stat(indexPath.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    return false;
+  }
+
+  MappedFile file(indexPath);
+
+  if (!file.is_open())
+  {
+    return false;
+  }
+
+  utility::Hasher hasher;
+  hasher.update(file.data());
+
+  key.size = static_cast<uint64_t>(st.st_size);
+  key.mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec;
+  key.contentHash = hasher.value();
+  key.settings = settings;
+  return true;
+}
+
+void DictionarySnapshot::build(const Key& key, const vector<pair<string_view, Entry>>& entries,
+  const Stats& stats, const RejectBatch& rejects)
+{
+  string strings;
+
+  auto addString = [&strings](string_view str) {
+    Ref ref{ static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(str.size()) };
+    strings += str;
+    return ref;
+  };
+
+  // At most half of the buckets are used
+  uint32_t bucketCount = 2;
+
+  while (bucketCount < entries.size() * 2)
+  {
+    bucketCount <<= 1;
+  }
+
+  vector<uint32_t> buckets(bucketCount, 0);
+  vector<EntryRecord> entryRecords;
+  entryRecords.reserve(entries.size());
+
+  for (const auto& [entryKey, entry] : entries)
+  {
+    const uint64_t hash = utility::hashKey(entryKey);
+    size_t bucket = hash & (bucketCount - 1);
+
+    while (buckets[bucket] != 0)
+    {
+      bucket = (bucket + 1) & (bucketCount - 1);
+    }
+
+    entryRecords.push_back({ addString(entryKey), addString(entry.country), addString(entry.state),
+      addString(entry.locality), addString(entry.fragment), entry.level, static_cast<uint32_t>(hash) });
+    // Zero marks an empty bucket
+    buckets[bucket] = static_cast<uint32_t>(entryRecords.size());
+  }
+
+  vector<RejectRecord> rejectRecords;
+
+  rejects.forEach([&](unsigned reason, size_t row, string_view data) {
+    rejectRecords.push_back({ reason, static_cast<uint32_t>(row), addString(data) });
+  });
+
+  Header header;
+  ::memcpy(header.magic, s_magic, sizeof(header.magic));
+  header.format = s_format;
+  header.key = key;
+  header.fingerprint = stats.fingerprint;
+  header.rows = stats.rows;
+  header.rejected = stats.rejected;
+  header.filtered = stats.filtered;
+  header.entryCount = static_cast<uint32_t>(entryRecords.size());
+  header.bucketCount = bucketCount;
+  header.rejectCount = static_cast<uint32_t>(rejectRecords.size());
+  header.bucketsOffset = align(sizeof(Header));
+  header.entriesOffset = align(header.bucketsOffset + buckets.size() * sizeof(uint32_t));
+  header.rejectsOffset = align(header.entriesOffset + entryRecords.size() * sizeof(EntryRecord));
+  header.stringsOffset = align(header.rejectsOffset + rejectRecords.size() * sizeof(RejectRecord));
+  header.stringsSize = strings.size();
+  header.totalSize = header.stringsOffset + strings.size();
+
+  m_image.assign(header.totalSize, '\0');
+  ::memcpy(m_image.data(), &header, sizeof(header));
+  ::memcpy(m_image.data() + header.bucketsOffset, buckets.data(), buckets.size() * sizeof(uint32_t));
+  ::memcpy(m_image.data() + header.entriesOffset, entryRecords.data(), entryRecords.size() * sizeof(EntryRecord));
+  ::memcpy(m_image.data() + header.rejectsOffset, rejectRecords.data(), rejectRecords.size() * sizeof(RejectRecord));
+  ::memcpy(m_image.data() + header.stringsOffset, strings.data(), strings.size());
+
+  m_pFile.reset();
+  m_data = string_view(m_image.data(), m_image.size());
+}
+
+bool DictionarySnapshot::save(const string& path) const
+{
+  const string tempPath = path + ".tmp";
+  {
+    OutputWriter writer;
+
+    if (!writer.open(tempPath))
+    {
+      return false;
+    }
+
+    writer.write(m_data);
+    writer.close();
+
+    if (writer.bad())
+    {
+      ::remove(tempPath.c_str());
+      return false;
+    }
+  }
+
+  return ::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+bool DictionarySnapshot::load(const string& path, const Key& key, size_t reasonCount)
+{
+  unique_ptr<MappedFile> pFile(new MappedFile(path));
+
+  if (!pFile->is_open() || !validate(pFile->data(), key, reasonCount))
+  {
+    return false;
+  }
+
+  m_pFile = move(pFile);
+  m_image.clear();
+  m_data = m_pFile->data();
+  return true;
+}
+
+bool DictionarySnapshot::validate(string_view data, const Key& key, size_t reasonCount) const
+{
+  if (data.size() < sizeof(Header))
+  {
+    return false;
+  }
+
+  const Header& h = *reinterpret_cast<const Header*>(data.data());
+
+  bool ret = ::memcmp(h.magic, s_magic, sizeof(s_magic)) == 0 && h.format == s_format &&
+    h.key.size == key.size && h.key.mtime == key.mtime &&
+    h.key.contentHash == key.contentHash && h.key.settings == key.settings &&
+    h.totalSize == data.size() && h.bucketCount > h.entryCount &&
+    (h.bucketCount & (h.bucketCount - 1)) == 0 &&
+    h.bucketsOffset % 8 == 0 && h.entriesOffset % 8 == 0 && h.rejectsOffset % 8 == 0 &&
+    h.bucketsOffset >= sizeof(Header) &&
+    h.bucketsOffset + uint64_t(h.bucketCount) * sizeof(uint32_t) <= h.entriesOffset &&
+    h.entriesOffset + uint64_t(h.entryCount) * sizeof(EntryRecord) <= h.rejectsOffset &&
+    h.rejectsOffset + uint64_t(h.rejectCount) * sizeof(RejectRecord) <= h.stringsOffset &&
+    h.stringsOffset + h.stringsSize == h.totalSize;
+
+  if (!ret)
+  {
+    return false;
+  }
+
+  // The records must not refer past the strings
+  auto isValid = [&h](const Ref& ref) { return uint64_t(ref.offset) + ref.length <= h.stringsSize; };
+  const uint32_t* pBuckets = reinterpret_cast<const uint32_t*>(data.data() + h.bucketsOffset);
+  const EntryRecord* pEntries = reinterpret_cast<const EntryRecord*>(data.data() + h.entriesOffset);
+  const RejectRecord* pRejects = reinterpret_cast<const RejectRecord*>(data.data() + h.rejectsOffset);
+
+  // Each entry occupies a bucket, the remaining buckets are empty and stop
+  // the probing of find()
+  uint32_t occupied = 0;
+
+  for (uint32_t i = 0; ret && i < h.bucketCount; ++i)
+  {
+    ret = pBuckets[i] <= h.entryCount;
+    occupied += pBuckets[i] != 0;
+  }
+
+  ret = ret && occupied == h.entryCount;
+
+  for (uint32_t i = 0; ret && i < h.entryCount; ++i)
+  {
+    const EntryRecord& e = pEntries[i];
+    ret = isValid(e.key) && isValid(e.country) && isValid(e.state) && isValid(e.locality) && isValid(e.fragment) &&
+      e.level <= s_maxLevel;
+  }
+
+  for (uint32_t i = 0; ret && i < h.rejectCount; ++i)
+  {
+    ret = isValid(pRejects[i].data) && pRejects[i].reason < reasonCount;
+  }
+
+  return ret;
+}
+
+bool DictionarySnapshot::find(string_view key, Entry& entry) const
+{
+  const Header& h = header();
+  const uint32_t* pBuckets = reinterpret_cast<const uint32_t*>(m_data.data() + h.bucketsOffset);
+  const EntryRecord* pEntries = reinterpret_cast<const EntryRecord*>(m_data.data() + h.entriesOffset);
+  const uint64_t hash = utility::hashKey(key);
+  const uint32_t mask = h.bucketCount - 1;
+
+  // There is at least one empty bucket
+  for (uint32_t bucket = hash & mask; pBuckets[bucket] != 0; bucket = (bucket + 1) & mask)
+  {
+    const EntryRecord& e = pEntries[pBuckets[bucket] - 1];
+
+    if (e.hash == static_cast<uint32_t>(hash) && get_string(e.key) == key)
+    {
+      entry.country = get_string(e.country);
+      entry.state = get_string(e.state);
+      entry.locality = get_string(e.locality);
+      entry.level = e.level;
+      entry.fragment = get_string(e.fragment);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+size_t DictionarySnapshot::size() const
+{
+  return header().entryCount;
+}
+
+DictionarySnapshot::Stats DictionarySnapshot::getStats() const
+{
+  const Header& h = header();
+  Stats ret;
+  ret.rows = h.rows;
+  ret.rejected = h.rejected;
+  ret.filtered = h.filtered;
+  ret.fingerprint = h.fingerprint;
+  return ret;
+}
+
+void DictionarySnapshot::getRejects(RejectBatch& rejects) const
+{
+  const Header& h = header();
+  const RejectRecord* pRejects = reinterpret_cast<const RejectRecord*>(m_data.data() + h.rejectsOffset);
+
+  for (uint32_t i = 0; i < h.rejectCount; ++i)
+  {
+    rejects.add(pRejects[i].reason, pRejects[i].row, get_string(pRejects[i].data));
+  }
+}
+
+string_view DictionarySnapshot::get_string(const Ref& ref) const
+{
+  return m_data.substr(header().stringsOffset + ref.offset, ref.length);
+}
+
+const DictionarySnapshot::Header& DictionarySnapshot::header() const
+{
+  return *reinterpret_cast<const Header*>(m_data.data());
+}
@@ -0,0 +1,95 @@
+/*
+  DictionarySnapshot holds the validated index dictionary in a single block
+  of memory: a header, an open addressing hash table, the entries and the
+  strings they refer to, all addressed by offsets. The block is saved to a
+  snapshot file that is memory mapped and used as it is by the subsequent
+  runs, so that loading the dictionary neither parses the index file nor
+  allocates memory per entry. Each entry carries the output fragment its
+  geoindex is rendered to. The snapshot is keyed by the size, the
+  modification time and the content hash of the index file and by the
+  settings the dictionary was built with, it is rebuilt if the key changes.
+  Apart from the dictionary, the snapshot holds the outcome of the index
+  processing: the row counts and the rejected rows.
+*/
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "MappedFile.h"
+#include "RejectWriter.h"
+
+class DictionarySnapshot
+{
+public:
+  struct Entry
+  {
+    std::string_view country;
+    std::string_view state;
+    std::string_view locality;
+    unsigned level;
+    // The output fields rendered at build time
+    std::string_view fragment;
+  };
+
+  // Identifies the index file and the settings of the dictionary
+  struct Key
+  {
+    std::uint64_t size = 0;
+    std::uint64_t mtime = 0;
+    std::uint64_t contentHash = 0;
+    std::uint64_t settings = 0;
+  };
+
+  struct Stats
+  {
+    unsigned rows = 0;
+    unsigned rejected = 0;
+    unsigned filtered = 0;
+    // Changes whenever the content of the dictionary changes
+    std::uint64_t fingerprint = 0;
+  };
+
+  DictionarySnapshot();
+  DictionarySnapshot(const DictionarySnapshot&) = delete;
+  DictionarySnapshot& operator=(const DictionarySnapshot&) = delete;
+
+  // Returns false if the index file is not a regular file
+  static bool getKey(const std::string& indexPath, std::uint64_t settings, Key& key);
+
+  // Builds the snapshot in memory
+  void build(const Key& key, const std::vector<std::pair<std::string_view, Entry>>& entries,
+    const Stats& stats, const RejectBatch& rejects);
+  // Replaces the file atomically
+  bool save(const std::string& path) const;
+  // Maps the snapshot file, returns false if it is missing, has another key
+  // or is not valid. The reasons of the rejects must be below reasonCount,
+  // i.e. index the reasons of the RejectWriter.
+  bool load(const std::string& path, const Key& key, std::size_t reasonCount);
+
+  bool find(std::string_view key, Entry& entry) const;
+  std::size_t size() const;
+  Stats getStats() const;
+  // Adds the rejected index rows to the batch
+  void getRejects(RejectBatch& rejects) const;
+
+  // The highest aggregation level of a valid entry
+  static const unsigned s_maxLevel = 3;
+
+private:
+  struct Header;
+  struct Ref;
+  struct EntryRecord;
+  struct RejectRecord;
+
+  bool validate(std::string_view data, const Key& key, std::size_t reasonCount) const;
+  std::string_view get_string(const Ref& ref) const;
+  const Header& header() const;
+
+  std::vector<char> m_image;
+  std::unique_ptr<MappedFile> m_pFile;
+  // Either the image or the mapped file
+  std::string_view m_data;
+};
@@ -0,0 +1,294 @@
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "InputSource.h"
+#include "DecompressingInputSource.h"
+
+using namespace std;
+
+bool InputSource::getLine(string_view& line)
+{
+  if (m_bFail)
+  {
+    return false;
+  }
+
+  bool ret = get_line(line);
+
+  if (!ret)
+  {
+    m_bFail = true;
+  }
+
+  return ret;
+}
+
+bool InputSource::getBlock(size_t size, string_view& block)
+{
+  if (m_bFail)
+  {
+    return false;
+  }
+
+  bool ret = get_block(size > 0 ? size : 1, block);
+
+  if (!ret)
+  {
+    m_bFail = true;
+  }
+
+  return ret;
+}
+
+unique_ptr<InputSource> InputSource::create(const string& path, bool bMapped)
+{
+  string filePath = path;
+
+  if (::access(path.c_str(), F_OK) != 0)
+  {
+    for (const char* extension : { ".gz", ".zst" })
+    {
+      if (::access((path + extension).c_str(), F_OK) == 0)
+      {
+        filePath = path + extension;
+        break;
+      }
+    }
+  }
+
+  // The compression is recognised by the content rather than the extension
+  const auto compression = DecompressingInputSource::getCompression(filePath);
+
+  if (compression != Compression::E_NONE)
+  {
+    return unique_ptr<InputSource>(new DecompressingInputSource(filePath, compression));
+  }
+
+  if (bMapped && MappedFile::isMappable(filePath))
+  {
+    return unique_ptr<InputSource>(new MappedInputSource(filePath));
+  }
+
+  return unique_ptr<InputSource>(new BufferedInputSource(filePath));
+}
+
+MemoryInputSource::MemoryInputSource(string_view data)
+{
+  reset(data);
+}
+
+void MemoryInputSource::reset(string_view data)
+{
+  m_data = data;
+  m_classifier.reset(data);
+  m_pos = 0;
+  m_bOpen = true;
+  m_bFail = false;
+  m_bStable = true;
+}
+
+bool MemoryInputSource::get_line(string_view& line)
+{
+  if (m_pos >= m_data.size())
+  {
+    return false;
+  }
+
+  const size_t pos = m_classifier.findNewline(m_pos);
+  line = m_data.substr(m_pos, pos - m_pos);
+  m_pos = pos + 1;
+  return true;
+}
+
+bool MemoryInputSource::get_block(size_t size, string_view& block)
+{
+  if (m_pos >= m_data.size())
+  {
+    return false;
+  }
+
+  // The block ends with the line that contains its last requested byte
+  size_t pos = m_pos + size - 1;
+
+  if (pos < m_data.size())
+  {
+    pos = m_classifier.findNewline(pos);
+  }
+
+  pos = min(pos + 1, m_data.size());
+  block = m_data.substr(m_pos, pos - m_pos);
+  m_pos = pos;
+  return true;
+}
+
+MappedInputSource::MappedInputSource(const string& path) : m_file(path)
+{
+  reset(m_file.data());
+  m_bOpen = m_file.is_open();
+}
+
+BufferedInputSource::BufferedInputSource(const string& path) :
+  m_fd(-1), m_bEof(false), m_buffer(s_blockSize), m_begin(0), m_end(0)
+{
+  m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  m_bOpen = m_fd >= 0;
+
+  if (m_bOpen)
+  {
+    ::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+}
+
+BufferedInputSource::~BufferedInputSource()
+{
+  if (m_fd >= 0)
+  {
+    ::close(m_fd);
+  }
+}
+
+bool BufferedInputSource::get_line(string_view& line)
+{
+  if (!m_bOpen)
+  {
+    return false;
+  }
+
+  size_t scanned = m_begin;
+
+  while (true)
+  {
+    const char* pBegin = m_buffer.data() + m_begin;
+    const char* pNewline = static_cast<const char*>(
+      ::memchr(m_buffer.data() + scanned, '\n', m_end - scanned));
+
+    if (pNewline)
+    {
+      line = string_view(pBegin, pNewline - pBegin);
+      m_begin = (pNewline - m_buffer.data()) + 1;
+      return true;
+    }
+
+    if (m_bEof)
+    {
+      if (m_begin == m_end)
+      {
+        return false;
+      }
+
+      line = string_view(pBegin, m_end - m_begin);
+      m_begin = m_end;
+      return true;
+    }
+
+    // The line continues past the buffered data, do not rescan its beginning
+    const size_t scannedLen = m_end - m_begin;
+
+    if (!fill_buffer())
+    {
+      m_bBad = true;
+      return false;
+    }
+
+    scanned = m_begin + scannedLen;
+  }
+}
+
+bool BufferedInputSource::get_block(size_t size, string_view& block)
+{
+  if (!m_bOpen)
+  {
+    return false;
+  }
+
+  // Buffer the requested amount of data first, then look for the end of line
+  while (m_end - m_begin < size && !m_bEof)
+  {
+    if (!fill_buffer())
+    {
+      m_bBad = true;
+      return false;
+    }
+  }
+
+  size_t scanned = min(m_begin + size - 1, m_end);
+
+  while (true)
+  {
+    const char* pNewline = static_cast<const char*>(
+      ::memchr(m_buffer.data() + scanned, '\n', m_end - scanned));
+
+    if (pNewline || m_bEof)
+    {
+      const size_t end = pNewline ? (pNewline - m_buffer.data()) + 1 : m_end;
+
+      if (end == m_begin)
+      {
+        return false;
+      }
+
+      block = string_view(m_buffer.data() + m_begin, end - m_begin);
+      m_begin = end;
+      return true;
+    }
+
+    const size_t scannedLen = m_end - m_begin;
+
+    if (!fill_buffer())
+    {
+      m_bBad = true;
+      return false;
+    }
+
+    scanned = m_begin + scannedLen;
+  }
+}
+
+bool BufferedInputSource::fill_buffer()
+{
+  size_t pending = m_end - m_begin;
+
+  if (m_begin > 0)
+  {
+    ::memmove(m_buffer.data(), m_buffer.data() + m_begin, pending);
+    m_begin = 0;
+    m_end = pending;
+  }
+
+  if (m_buffer.size() - m_end < s_blockSize / 2)
+  {
+    m_buffer.resize(m_buffer.size() * 2);
+  }
+
+  ssize_t len = read_data(m_buffer.data() + m_end, m_buffer.size() - m_end);
+
+  if (len < 0)
+  {
+    return false;
+  }
+
+  if (len == 0)
+  {
+    m_bEof = true;
+  }
+
+  m_end += static_cast<size_t>(len);
+  return true;
+}
+
+ssize_t BufferedInputSource::read_data(char* pBuffer, size_t size)
+{
+  while (true)
+  {
+    ssize_t len = ::read(m_fd, pBuffer, size);
+
+    if (len < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    return len;
+  }
+}
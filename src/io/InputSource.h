@@ -0,0 +1,108 @@
+/*
+  InputSource supplies the rows of an input CSV file one line at a time.
+  The line is returned as a view that stays valid until the next call.
+  The file is either memory mapped or read in large blocks when mapping
+  is disabled or not possible (e.g. the input is a pipe). Compressed files
+  are decompressed on the fly, see DecompressingInputSource.
+  Alternatively the rows can be obtained in blocks of whole lines so that
+  the blocks can be processed in parallel.
+*/
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+#include "MappedFile.h"
+#include "../BlockClassifier.h"
+
+class InputSource
+{
+public:
+  virtual ~InputSource() {}
+
+  // Returns false when there are no more lines. Similar to std::getline,
+  // the terminating '\n' is not included and an empty segment following
+  // the last '\n' does not count as a line.
+  bool getLine(std::string_view& line);
+  // Returns false when there are no more lines. Otherwise the block holds
+  // at least size bytes (unless the end of file is reached) and ends after
+  // the '\n' terminating the last line of the block. The lines are split by
+  // the same rules as used by getLine(). Must not be mixed with getLine().
+  bool getBlock(std::size_t size, std::string_view& block);
+
+  bool is_open() const { return m_bOpen; }
+  // True if the lines and blocks remain valid until the source is destroyed
+  bool is_stable() const { return m_bStable; }
+  bool bad() const { return m_bBad; }
+  explicit operator bool() const { return !m_bFail; }
+
+  // If the file does not exist, its compressed version with the .gz or .zst
+  // extension appended to the path is looked for
+  static std::unique_ptr<InputSource> create(const std::string& path, bool bMapped);
+
+protected:
+  InputSource() : m_bOpen(false), m_bBad(false), m_bFail(false), m_bStable(false) {}
+
+  bool m_bOpen;
+  bool m_bBad;
+  bool m_bFail;
+  bool m_bStable;
+
+private:
+  virtual bool get_line(std::string_view& line) = 0;
+  virtual bool get_block(std::size_t size, std::string_view& block) = 0;
+};
+
+// Supplies the lines of data owned by the caller, e.g. a block of lines
+class MemoryInputSource : public InputSource
+{
+public:
+  explicit MemoryInputSource(std::string_view data = std::string_view());
+
+  void reset(std::string_view data);
+
+private:
+  bool get_line(std::string_view& line) override;
+  bool get_block(std::size_t size, std::string_view& block) override;
+
+  std::string_view m_data;
+  BlockClassifier m_classifier;
+  std::size_t m_pos;
+};
+
+class MappedInputSource : public MemoryInputSource
+{
+public:
+  MappedInputSource(const std::string& path);
+
+private:
+  MappedFile m_file;
+};
+
+class BufferedInputSource : public InputSource
+{
+public:
+  BufferedInputSource(const std::string& path);
+  ~BufferedInputSource();
+
+protected:
+  // Reads the file data into the buffer, returns the count of bytes read,
+  // 0 at the end of file or -1 on error
+  virtual ssize_t read_data(char* pBuffer, std::size_t size);
+
+  int m_fd;
+
+private:
+  bool get_line(std::string_view& line) override;
+  bool get_block(std::size_t size, std::string_view& block) override;
+  bool fill_buffer();
+
+  bool m_bEof;
+  std::vector<char> m_buffer;
+  std::size_t m_begin;
+  std::size_t m_end;
+
+  static const std::size_t s_blockSize = 1 << 20;
+};
@@ -0,0 +1,73 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "MappedFile.h"
+
+using namespace std;
+
+MappedFile::MappedFile(const string& path) : m_fd(-1), m_pData(nullptr), m_size(0)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+  {
+    return;
+  }
+
+  struct stat st;
+
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    ::close(fd);
+    return;
+  }
+
+  m_fd = fd;
+  m_size = static_cast<size_t>(st.st_size);
+
+  if (m_size == 0)
+  {
+    // mmap() rejects zero length, an empty file yields an empty view
+    return;
+  }
+
+  void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+  if (p == MAP_FAILED)
+  {
+    ::close(m_fd);
+    m_fd = -1;
+    m_size = 0;
+    return;
+  }
+
+  // The hints are advisory, failures are ignored. The kernel may not support
+  // transparent huge pages for file backed mappings.
+  ::madvise(p, m_size, MADV_SEQUENTIAL);
+#if defined(MADV_HUGEPAGE)
+  ::madvise(p, m_size, MADV_HUGEPAGE);
+#endif
+
+  m_pData = static_cast<const char*>(p);
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_pData)
+  {
+    ::munmap(const_cast<char*>(m_pData), m_size);
+  }
+
+  if (m_fd >= 0)
+  {
+    ::close(m_fd);
+  }
+}
+
+bool MappedFile::isMappable(const string& path)
+{
+  struct stat st;
+  bool ret = ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+  return ret;
+}
@@ -0,0 +1,30 @@
+/*
+  MappedFile maps a read-only input file into the process address space
+  so that CSV rows can be sliced directly from the mapping without being
+  copied through a stream buffer.
+*/
+#pragma once
+
+#include <string>
+#include <string_view>
+
+class MappedFile
+{
+public:
+  MappedFile(const std::string& path);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool is_open() const { return m_fd >= 0; }
+  std::string_view data() const { return std::string_view(m_pData, m_size); }
+  std::size_t size() const { return m_size; }
+
+  // Returns false if the file is not a regular file or cannot be mapped
+  static bool isMappable(const std::string& path);
+
+private:
+  int m_fd;
+  const char* m_pData;
+  std::size_t m_size;
+};
@@ -0,0 +1,127 @@
+#include <cerrno>
+#include <charconv>
+#include <fcntl.h>
+#include <unistd.h>
+#include "OutputWriter.h"
+
+using namespace std;
+
+void OutputBuffer::appendNumber(unsigned long long number)
+{
+  char buf[24];
+  const auto result = to_chars(buf, buf + sizeof(buf), number);
+  append(string_view(buf, result.ptr - buf));
+}
+
+OutputWriter::OutputWriter() : m_fd(-1), m_bBad(false)
+{
+  m_data.reserve(s_flushSize + (s_flushSize >> 2));
+}
+
+OutputWriter::~OutputWriter()
+{
+  close();
+}
+
+bool OutputWriter::open(const string& path, BlockCompressor::E_COMPRESSION compression, unsigned threadCount)
+{
+  close();
+  m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  m_bBad = false;
+
+  if (m_fd >= 0 && compression != Compression::E_NONE)
+  {
+    m_pCompressor.reset(new BlockCompressor(compression, threadCount,
+      [this](string_view data) { return write_all(data); }));
+  }
+
+  return m_fd >= 0;
+}
+
+void OutputWriter::write(string_view data)
+{
+  if (data.size() < s_flushSize)
+  {
+    append(data);
+    commit();
+    return;
+  }
+
+  // Preserve the order of the data
+  write_buffer();
+
+  if (!m_bBad && !write_data(data))
+  {
+    m_bBad = true;
+  }
+}
+
+void OutputWriter::flush()
+{
+  write_buffer();
+
+  if (m_pCompressor && !m_pCompressor->finish())
+  {
+    m_bBad = true;
+  }
+}
+
+void OutputWriter::write_buffer()
+{
+  if (m_data.empty())
+  {
+    return;
+  }
+
+  if (m_fd < 0 || m_bBad || !write_data(m_data))
+  {
+    m_bBad = true;
+  }
+
+  clear();
+}
+
+void OutputWriter::close()
+{
+  if (m_fd < 0)
+  {
+    return;
+  }
+
+  flush();
+  m_pCompressor.reset();
+
+  if (::close(m_fd) != 0)
+  {
+    m_bBad = true;
+  }
+
+  m_fd = -1;
+}
+
+bool OutputWriter::write_data(string_view data)
+{
+  return m_pCompressor ? m_pCompressor->submit(data) : write_all(data);
+}
+
+bool OutputWriter::write_all(string_view data)
+{
+  while (!data.empty())
+  {
+    const ssize_t len = ::write(m_fd, data.data(), data.size());
+
+    if (len < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (len <= 0)
+    {
+      return false;
+    }
+
+    data.remove_prefix(static_cast<size_t>(len));
+  }
+
+  return true;
+}
@@ -0,0 +1,111 @@
+/*
+  OutputBuffer accumulates CSV output in memory. It takes care of the
+  field separators and row terminators so that the callers append fields
+  without formatting them through iostreams.
+  OutputWriter is an OutputBuffer that writes to a file using write(2).
+  The data is flushed in blocks of several megabytes, data larger than
+  the buffer is written directly. Optionally the data is compressed on
+  worker threads before it is written, see BlockCompressor.
+*/
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include "BlockCompressor.h"
+
+class OutputBuffer
+{
+public:
+  OutputBuffer() : m_rowStart(0), m_bFirstField(true) {}
+
+  // Appends the field preceded by a separator unless it's the first field
+  // of the row
+  void appendField(std::string_view field)
+  {
+    if (!m_bFirstField)
+    {
+      m_data += ',';
+    }
+
+    m_data += field;
+    m_bFirstField = false;
+  }
+
+  // Completes the row
+  void endRow()
+  {
+    m_data += '\n';
+    beginRow();
+  }
+
+  // Removes the fields appended since the current row began
+  void discardRow()
+  {
+    m_data.resize(m_rowStart);
+    m_bFirstField = true;
+  }
+
+  // Appends raw data that is not a part of a row built by appendField()
+  void append(std::string_view data) { m_data += data; beginRow(); }
+  void append(char c) { m_data += c; beginRow(); }
+  void appendNumber(unsigned long long number);
+
+  void clear() { m_data.clear(); beginRow(); }
+  std::string_view data() const { return m_data; }
+  std::size_t size() const { return m_data.size(); }
+
+  // Starts a new row without terminating the current one
+  void beginRow()
+  {
+    m_rowStart = m_data.size();
+    m_bFirstField = true;
+  }
+
+protected:
+  std::string m_data;
+  std::size_t m_rowStart;
+  bool m_bFirstField;
+};
+
+class OutputWriter : public OutputBuffer
+{
+public:
+  OutputWriter();
+  ~OutputWriter();
+  OutputWriter(const OutputWriter&) = delete;
+  OutputWriter& operator=(const OutputWriter&) = delete;
+
+  // Creates or truncates the file. Unless compression is E_NONE the data is
+  // written as a gzip or zstd stream compressed by threadCount threads.
+  bool open(const std::string& path,
+    BlockCompressor::E_COMPRESSION compression = Compression::E_NONE,
+    unsigned threadCount = 1);
+  bool is_open() const { return m_fd >= 0; }
+  bool bad() const { return m_bBad; }
+
+  // Writes the data past the buffer if it is large, otherwise buffers it
+  void write(std::string_view data);
+  // Writes the buffered data if it has reached the flush size
+  void commit()
+  {
+    if (m_data.size() >= s_flushSize)
+    {
+      write_buffer();
+    }
+  }
+  // Writes the buffered data and waits for its compression if enabled
+  void flush();
+  void close();
+
+private:
+  void write_buffer();
+  bool write_data(std::string_view data);
+  bool write_all(std::string_view data);
+
+  int m_fd;
+  bool m_bBad;
+  std::unique_ptr<BlockCompressor> m_pCompressor;
+
+  static const std::size_t s_flushSize = 4 << 20;
+};
@@ -0,0 +1,197 @@
+#include <cassert>
+#include "RejectWriter.h"
+
+using namespace std;
+
+RejectWriter::RejectWriter(const vector<Reason>& reasons, unsigned limit, unsigned sampling) :
+  m_reasons(reasons), m_limit(limit), m_sampling(sampling),
+  m_counts(reasons.size(), 0), m_omitted(reasons.size(), 0),
+  m_bBusy(false), m_bStop(false), m_bBad(false)
+{
+}
+
+RejectWriter::~RejectWriter()
+{
+  close();
+}
+
+bool RejectWriter::open(const string& path)
+{
+  if (is_open() || !m_writer.open(path))
+  {
+    return false;
+  }
+
+  m_bStop = false;
+  m_bBad = false;
+  m_thread = thread(&RejectWriter::run, this);
+  return true;
+}
+
+void RejectWriter::add(unsigned reason, size_t row, string_view data)
+{
+  m_current.add(reason, row, data);
+  submit_current(false);
+}
+
+void RejectWriter::submit(RejectBatch& batch, size_t rowOffset)
+{
+  // Preserve the order of the rejects
+  submit_current(true);
+
+  if (!batch.empty())
+  {
+    enqueue(batch, rowOffset);
+  }
+}
+
+void RejectWriter::flush()
+{
+  submit_current(true);
+
+  unique_lock<mutex> lock(m_mutex);
+  m_cvProducer.wait(lock, [this]() { return m_queue.empty() && !m_bBusy; });
+
+  // The background thread is idle and cannot resume while the lock is held
+  m_writer.flush();
+
+  if (m_writer.bad())
+  {
+    m_bBad = true;
+  }
+}
+
+void RejectWriter::close()
+{
+  if (!is_open())
+  {
+    return;
+  }
+
+  flush();
+
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_bStop = true;
+  }
+
+  m_cvWriter.notify_one();
+  m_thread.join();
+
+  for (size_t i = 0; i < m_reasons.size(); ++i)
+  {
+    if (m_omitted[i])
+    {
+      m_writer.append(m_reasons[i].name);
+      m_writer.append(": omitted ");
+      m_writer.appendNumber(m_omitted[i]);
+      m_writer.append(" more rejected rows\n");
+    }
+  }
+
+  m_writer.close();
+
+  if (m_writer.bad())
+  {
+    m_bBad = true;
+  }
+}
+
+void RejectWriter::submit_current(bool bForce)
+{
+  if (!m_current.empty() && (bForce || m_current.size() >= s_batchSize))
+  {
+    enqueue(m_current, 0);
+  }
+}
+
+void RejectWriter::enqueue(RejectBatch& batch, size_t rowOffset)
+{
+  if (!is_open())
+  {
+    batch.clear();
+    return;
+  }
+
+  unique_lock<mutex> lock(m_mutex);
+  m_cvProducer.wait(lock, [this]() { return m_queue.size() < s_maxQueued; });
+
+  // Hand the batch over and give the caller a recycled one
+  RejectBatch spare;
+
+  if (!m_free.empty())
+  {
+    spare = move(m_free.back());
+    m_free.pop_back();
+  }
+
+  m_queue.push_back({move(batch), rowOffset});
+  batch = move(spare);
+  batch.clear();
+  lock.unlock();
+  m_cvWriter.notify_one();
+}
+
+void RejectWriter::run()
+{
+  unique_lock<mutex> lock(m_mutex);
+
+  while (true)
+  {
+    m_cvWriter.wait(lock, [this]() { return !m_queue.empty() || m_bStop; });
+
+    if (m_queue.empty())
+    {
+      break;
+    }
+
+    QueuedBatch queued = move(m_queue.front());
+    m_queue.pop_front();
+    m_bBusy = true;
+    lock.unlock();
+    m_cvProducer.notify_all();
+
+    write_batch(queued);
+
+    lock.lock();
+    queued.batch.clear();
+    m_free.push_back(move(queued.batch));
+    m_bBusy = false;
+    m_cvProducer.notify_all();
+  }
+}
+
+void RejectWriter::write_batch(const QueuedBatch& queued)
+{
+  const string_view data = queued.batch.m_data.data();
+
+  for (const auto& record : queued.batch.m_records)
+  {
+    assert(record.reason < m_reasons.size());
+    const auto& reason = m_reasons[record.reason];
+    const size_t count = ++m_counts[record.reason];
+
+    if (m_limit && count > m_limit && (m_sampling == 0 || (count - m_limit) % m_sampling != 0))
+    {
+      ++m_omitted[record.reason];
+      continue;
+    }
+
+    m_writer.append(reason.prefix);
+
+    if (reason.bRowNumber)
+    {
+      m_writer.appendNumber(queued.rowOffset + record.row);
+      m_writer.append(": ");
+    }
+
+    m_writer.append(data.substr(record.offset, record.length));
+    m_writer.append('\n');
+    m_writer.commit();
+  }
+
+  if (m_writer.bad())
+  {
+    m_bBad = true;
+  }
+}
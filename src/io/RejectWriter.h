@@ -0,0 +1,153 @@
+/*
+  RejectWriter writes the rejected rows to a reject file on a background
+  thread. The rejects are collected as compact records (row number, reason
+  code and the rejected data) in batches that are handed over to the thread
+  as a whole. The writer can be configured to limit the count of rejects
+  written for each reason: once the limit is reached only a sample of the
+  subsequent rejects is written and the count of the omitted ones is
+  appended to the file when it is closed.
+*/
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <string_view>
+#include <condition_variable>
+#include "OutputWriter.h"
+
+class RejectBatch
+{
+public:
+  void add(unsigned reason, std::size_t row, std::string_view data)
+  {
+    const std::size_t offset = m_data.size();
+    m_data.append(data);
+    m_records.push_back({row, reason, offset, data.size()});
+  }
+
+  // Stores the fields separated by commas
+  template <typename Fields>
+  void addFields(unsigned reason, std::size_t row, const Fields& fields)
+  {
+    const std::size_t offset = m_data.size();
+
+    for (const auto& field : fields)
+    {
+      m_data.appendField(field);
+    }
+
+    m_data.beginRow();
+    m_records.push_back({row, reason, offset, m_data.size() - offset});
+  }
+
+  // Calls f(reason, row, data) for each reject in the order of addition
+  template <typename F>
+  void forEach(F f) const
+  {
+    for (const auto& record : m_records)
+    {
+      f(record.reason, record.row, m_data.data().substr(record.offset, record.length));
+    }
+  }
+
+  void clear() { m_records.clear(); m_data.clear(); }
+  bool empty() const { return m_records.empty(); }
+  std::size_t size() const { return m_data.size(); }
+
+private:
+  friend class RejectWriter;
+
+  struct Record
+  {
+    std::size_t row;
+    unsigned reason;
+    std::size_t offset;
+    std::size_t length;
+  };
+
+  std::vector<Record> m_records;
+  OutputBuffer m_data;
+};
+
+class RejectWriter
+{
+public:
+  struct Reason
+  {
+    // Used by the summary of omitted rejects
+    const char* name;
+    // Precedes the rejected data
+    const char* prefix;
+    // Whether the row number follows the prefix
+    bool bRowNumber;
+  };
+
+  // The limit is the count of rejects written for each reason, 0 stands for
+  // no limit. Beyond the limit every sampling-th reject is written, 0 stands
+  // for none.
+  RejectWriter(const std::vector<Reason>& reasons, unsigned limit = 0, unsigned sampling = 0);
+  ~RejectWriter();
+  RejectWriter(const RejectWriter&) = delete;
+  RejectWriter& operator=(const RejectWriter&) = delete;
+
+  // Creates or truncates the file and starts the background thread
+  bool open(const std::string& path);
+  bool is_open() const { return m_thread.joinable(); }
+  bool bad() const { return m_bBad; }
+
+  void add(unsigned reason, std::size_t row, std::string_view data);
+  template <typename Fields>
+  void addFields(unsigned reason, std::size_t row, const Fields& fields)
+  {
+    m_current.addFields(reason, row, fields);
+    submit_current(false);
+  }
+
+  // Queues the batch adding rowOffset to its row numbers. The batch is left
+  // empty and can be reused.
+  void submit(RejectBatch& batch, std::size_t rowOffset = 0);
+  // Waits until the queued rejects are written to the file
+  void flush();
+  // Writes the summary of omitted rejects and closes the file
+  void close();
+
+private:
+  struct QueuedBatch
+  {
+    RejectBatch batch;
+    std::size_t rowOffset;
+  };
+
+  void submit_current(bool bForce);
+  void enqueue(RejectBatch& batch, std::size_t rowOffset);
+  void run();
+  void write_batch(const QueuedBatch& queued);
+
+  const std::vector<Reason> m_reasons;
+  const unsigned m_limit;
+  const unsigned m_sampling;
+  // Per reason counts of the rejects and the omitted rejects
+  std::vector<std::size_t> m_counts;
+  std::vector<std::size_t> m_omitted;
+
+  OutputWriter m_writer;
+  RejectBatch m_current;
+  std::deque<QueuedBatch> m_queue;
+  std::vector<RejectBatch> m_free;
+  std::mutex m_mutex;
+  std::condition_variable m_cvWriter;
+  std::condition_variable m_cvProducer;
+  std::thread m_thread;
+  bool m_bBusy;
+  bool m_bStop;
+  std::atomic<bool> m_bBad;
+
+  // Size of the data collected by add() before the batch is queued
+  static const std::size_t s_batchSize = 64 << 10;
+  // Count of the queued batches the producer waits for to be written
+  static const std::size_t s_maxQueued = 8;
+};
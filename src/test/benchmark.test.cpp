@@ -0,0 +1,152 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <array>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <vector>
+#include "catch.hpp"
+#include "../CsvRowReader.h"
+#include "../config/BuildConfig.h"
+#include "../utility.h"
+
+using namespace std;
+
+// The benchmarks are hidden, run them using: ./build/crisp-csv [benchmark]
+
+TEST_CASE( "Benchmark row reader field resolution", "[.benchmark]" )
+{
+  constexpr unsigned DataFieldCount = CsvFieldCounts::s_inputGoogle;
+  const array<unsigned, DataFieldCount> indices{0,1,6,7,8};
+  CsvRowReader<DataFieldCount> reader(indices);
+
+  istringstream stream("2020-08-01,US_CA_06037,0,0,0,0,1000,,20,0,0");
+  stream >> reader;
+
+  // The red-black tree lookup used by earlier versions of CsvRowReader
+  map<unsigned, unsigned> slotMap;
+  unsigned ordinal = 0;
+
+  for (const auto& ind : indices)
+  {
+    slotMap.emplace(ind, ordinal++);
+  }
+
+  BENCHMARK( "std::map field resolution" )
+  {
+    size_t ret = 0;
+
+    for (const auto& ind : indices)
+    {
+      const map<unsigned, unsigned>::const_iterator it = slotMap.find(ind);
+      ret += distance(slotMap.cbegin(), it);
+    }
+
+    return ret;
+  };
+
+  BENCHMARK( "slot table field resolution" )
+  {
+    size_t ret = 0;
+
+    for (const auto& ind : indices)
+    {
+      ret += reader[ind].size();
+    }
+
+    return ret;
+  };
+
+  BENCHMARK( "row tokenization" )
+  {
+    stream.clear();
+    stream.seekg(0);
+    stream >> reader;
+    return reader[1].size();
+  };
+}
+
+TEST_CASE( "Benchmark pattern matchers", "[.benchmark]" )
+{
+  // The patterns the matchers were compiled from, std::regex cannot express
+  // the UTF-8 range of the locality group hence the ASCII subset
+  const regex indexPattern("^[A-Z]{2}(_[A-Z0-9]{1,3})?(_[A-Za-z0-9]{1,12})?$");
+  const regex datePattern("^20[1-2][0-9]-\\d{2}-\\d{2}$");
+  const regex nutsPattern("^GB_UK[A-Z]$");
+
+  const vector<string> indices{ "AU", "AU_NSW", "US_CA_06037", "GB_UKC", "BR_SP_3550308", "AA_BB_1234567890123" };
+  const vector<string> dates{ "2020-08-01", "2021-12-31", "2030-01-01", "2020-8-1" };
+
+  BENCHMARK( "std::regex geoindex" )
+  {
+    unsigned ret = 0;
+    smatch mr;
+
+    for (const auto& index : indices)
+    {
+      ret += regex_match(index, mr, indexPattern) + mr[1].matched + mr[2].matched;
+    }
+
+    return ret;
+  };
+
+  BENCHMARK( "matchIndex geoindex" )
+  {
+    unsigned ret = 0;
+
+    for (const auto& index : indices)
+    {
+      const auto mr = utility::matchIndex(index);
+      ret += mr.matched + mr.state + mr.locality;
+    }
+
+    return ret;
+  };
+
+  BENCHMARK( "std::regex date" )
+  {
+    unsigned ret = 0;
+
+    for (const auto& date : dates)
+    {
+      ret += regex_match(date, datePattern);
+    }
+
+    return ret;
+  };
+
+  BENCHMARK( "parseDate date" )
+  {
+    unsigned ret = 0;
+
+    for (const auto& date : dates)
+    {
+      ret += utility::parseDate(date) != utility::g_invalidDate;
+    }
+
+    return ret;
+  };
+
+  BENCHMARK( "std::regex UK NUTS" )
+  {
+    unsigned ret = 0;
+
+    for (const auto& index : indices)
+    {
+      ret += regex_match(index, nutsPattern);
+    }
+
+    return ret;
+  };
+
+  BENCHMARK( "isUkNuts UK NUTS" )
+  {
+    unsigned ret = 0;
+
+    for (const auto& index : indices)
+    {
+      ret += utility::isUkNuts(index);
+    }
+
+    return ret;
+  };
+}
@@ -1,8 +1,86 @@
+#include <set>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <unistd.h>
 #include "catch.hpp"
 #include "../utility.h"
 #include "../WorkUnit.h"
 #include "../WorkFactory.h"
 #include "../config/BuildConfig.h"
+#include "../CsvFile.h"
+#include "../handlers/HandlerFactory.h"
+#include "../handlers/CsvScannerGoogle.h"
+#include "../handlers/CsvProcessorGoogle.h"
+
+using namespace std;
+
+namespace
+{
+  typedef CsvFile<
+    CsvFieldCounts::s_inputGoogle,
+    CsvFieldCounts::s_indexGoogle,
+    CsvFieldCounts::s_processingGoogle,
+    CsvScannerGoogle,
+    CsvProcessorGoogle<>
+  > GoogleCsvFile;
+
+  // Created like by WorkFactory, the count of threads and the threading
+  // mode override the configuration file
+  class ThreadedCsvFile : public GoogleCsvFile
+  {
+  public:
+    using GoogleCsvFile::RunStats;
+
+    ThreadedCsvFile(const string& inFile, const string& outFile, unsigned threadCount, bool bPipeline) :
+      GoogleCsvFile(utility::constructPath(inFile), utility::constructPath(outFile),
+        { make_tuple(0,false), make_tuple(1,true), make_tuple(6,false), make_tuple(7,false), make_tuple(8,false) },
+        processor(), scanner())
+    {
+      m_threadCount = threadCount;
+      m_bPipeline = bPipeline;
+    }
+
+    const RunStats& getRuns() const { return m_runs; }
+
+  private:
+    static ProcessorPtr processor()
+    {
+      auto pHandler = HandlerFactory::createCsvProcessor<CsvFieldCounts::s_indexGoogle>(
+        HandlerFactory::E_GoogleCsvProcessor,
+        "/../src/test/data/index-valid.csv");
+      return static_pointer_cast<CsvProcessorGoogle<>>(
+        static_pointer_cast<HandlerFactory::GoogleCsvProcessor>(pHandler));
+    }
+
+    static ScannerPtr scanner()
+    {
+      return static_pointer_cast<CsvScannerGoogle>(
+        HandlerFactory::createCsvScanner(HandlerFactory::E_GoogleCsvScanner));
+    }
+  };
+
+  // Writes the rows of data-valid.csv repeated in runs of the given length
+  void writeLargeData(const string& path, unsigned runLength, unsigned runCount)
+  {
+    const char* rows[] = {
+      "2020-01-24,AA_BB_CC1,,,,,100,10,80,",
+      "2020-01-24,AA_BB,,,,,100,10,80,",
+      "2020-01-24,AA,,,,,100,10,80," };
+    ofstream out(utility::constructPath(path), ios::binary | ios::trunc);
+
+    for (unsigned run = 0; run < runCount; ++run)
+    {
+      for (unsigned i = 0; i < runLength; ++i)
+      {
+        out << rows[run % 3] << '\n';
+      }
+    }
+  }
+}
 
 TEST_CASE( "Integration test - valid data", "[integration]" )
 {
@@ -50,16 +128,181 @@ TEST_CASE( "Integration test - invalid data", "[integration]" )
   unsigned rejectedDataRows = csv->getRejectedCount();
   unsigned processedDataRows = csv->getProcessedCount();
 
+  // The incorrectly quoted last row is rejected rather than stopping the run
   if constexpr (g_skipLocalitiesBelowStateOrProvince == true)
   {
-    CHECK( rejectedIndexRows == 16 );
-    CHECK( rejectedDataRows == 2 );
-    CHECK( processedDataRows == 3 );
+    CHECK( rejectedIndexRows == 19 );
+    CHECK( rejectedDataRows == 3 );
+    CHECK( processedDataRows == 4 );
   }
   else
   {
-    CHECK( rejectedIndexRows == 19 );
-    CHECK( rejectedDataRows == 3 );
-    CHECK( processedDataRows == 3 );
+    CHECK( rejectedIndexRows == 21 );
+    CHECK( rejectedDataRows == 4 );
+    CHECK( processedDataRows == 4 );
+  }
+
+  // The aggregation level is a decimal number without a sign, the reader
+  // skips the whitespace preceding a field
+  ifstream rejects(utility::constructPath("/../src/test/data/index-invalid-reject.csv"));
+  vector<string> lines;
+
+  for (string line; getline(rejects, line);)
+  {
+    lines.push_back(line);
+  }
+
+  const string locality = g_skipLocalitiesBelowStateOrProvince ? "" : ",,";
+
+  for (const auto& expected : {
+    "Invalid aggregation level: AG,Test Country," + locality + ",+0",
+    "Invalid aggregation level: AH_BB,Test Country,Test Province" + locality + ",-1" })
+  {
+    CHECK( find(lines.begin(), lines.end(), expected) != lines.end() );
+  }
+
+  CHECK( none_of(lines.begin(), lines.end(), [](const string& line) { return line.find(": AI,") != string::npos; }) );
+}
+
+TEST_CASE( "Integration test - large index", "[integration]" )
+{
+  // The index file spans several chunks validated by separate threads and
+  // the repeated geoindexes are scattered across the chunks
+  const string indexPath = utility::constructPath("/../src/test/data/index-large.csv");
+  const string rejectPath = utility::constructPath("/../src/test/data/index-large-reject.csv");
+  remove((indexPath + ".snapshot").c_str());
+
+  mt19937 generator(25);
+  uniform_int_distribution<int> letter('A', 'Z');
+  set<string> indices;
+  vector<string> countries;
+  // The header is rejected like any other row
+  vector<string> expectedRejects{ g_skipLocalitiesBelowStateOrProvince ?
+    "Invalid aggregation level: key,country_name,subregion1_name,aggregation_level" :
+    "Invalid aggregation level: key,country_name,subregion1_name,subregion2_name,locality_name,aggregation_level" };
+
+  {
+    ofstream out(indexPath, ios::binary | ios::trunc);
+    out << "key,wikidata,datacommons,country_code,country_name,subregion1_code,subregion1_name,"
+      "subregion2_code,subregion2_name,locality_code,locality_name,iso_3166_1_alpha_2,"
+      "iso_3166_1_alpha_3,aggregation_level\n";
+
+    for (unsigned i = 0; i < 40000; ++i)
+    {
+      const string index = string("AA_") + char(letter(generator)) + char(letter(generator)) +
+        char(letter(generator));
+      const string country = "Country " + to_string(i);
+      const string state = "State " + to_string(i);
+      const bool bInvalid = i % 97 == 0;
+
+      out << index << ",,,," << country << ",," << state << ",,,,,,," << (bInvalid ? "x" : "1") << '\n';
+
+      string fields = index + ',' + country + ',' + state;
+
+      if constexpr (g_skipLocalitiesBelowStateOrProvince == false)
+      {
+        fields += ",,";
+      }
+
+      fields += bInvalid ? ",x" : ",1";
+
+      if (bInvalid)
+      {
+        expectedRejects.push_back("Invalid aggregation level: " + fields);
+      }
+      else if (!indices.insert(index).second)
+      {
+        expectedRejects.push_back("Repetition: " + fields);
+      }
+      else
+      {
+        countries.push_back(index + ',' + country + ',');
+      }
+    }
+  }
+
+  typename CsvProcessorGoogle<>::InputFields fields;
+  const unsigned indicesSkipped[] = { 0, 4, 6, 13 };
+  const unsigned indicesAll[] = { 0, 4, 6, 8, 10, 13 };
+  copy_n(g_skipLocalitiesBelowStateOrProvince ? indicesSkipped : indicesAll, fields.size(), fields.begin());
+
+  {
+    CsvProcessorGoogle<> processor(indexPath, move(fields));
+
+    CHECK( processor.getRejectedCount() == expectedRejects.size() );
+
+    // The first occurrence of a geoindex is kept
+    for (const auto& prefix : countries)
+    {
+      const auto result = processor.processField(prefix.substr(0, prefix.find(',')));
+      REQUIRE( result );
+      CHECK( result->substr(0, prefix.size()) == prefix );
+    }
   }
+
+  // The rejects are written in the order of the rows
+  ifstream rejects(rejectPath);
+  vector<string> lines;
+
+  for (string line; getline(rejects, line);)
+  {
+    lines.push_back(line);
+  }
+
+  CHECK( lines == expectedRejects );
+  remove(indexPath.c_str());
+  remove((indexPath + ".snapshot").c_str());
+}
+
+TEST_CASE( "Integration test - output error", "[integration]" )
+{
+  // Every write to /dev/full fails, the error is detected by a commit of
+  // a chunk while the threads are still running
+  const string outPath = utility::constructPath("/../src/test/data/out-full.csv");
+  unlink(outPath.c_str());
+  REQUIRE( symlink("/dev/full", outPath.c_str()) == 0 );
+  writeLargeData("/../src/test/data/data-large.csv", 1000, 300);
+
+  for (const bool bPipeline : { false, true })
+  {
+    ThreadedCsvFile csv("/../src/test/data/data-large.csv", "/../src/test/data/out-full.csv", 2, bPipeline);
+    CHECK_THROWS_AS( csv.process(), runtime_error );
+  }
+
+  unlink(outPath.c_str());
+  remove(utility::constructPath("/../src/test/data/data-large.csv").c_str());
+}
+
+TEST_CASE( "Integration test - runs spanning chunks", "[integration]" )
+{
+  // Each run of rows sharing a geoindex is longer than a chunk
+  writeLargeData("/../src/test/data/data-large.csv", 40000, 6);
+  vector<string> outputs;
+  vector<ThreadedCsvFile::RunStats> runs;
+
+  for (const auto& mode : { make_pair(1u, false), make_pair(2u, false), make_pair(3u, true) })
+  {
+    ThreadedCsvFile csv("/../src/test/data/data-large.csv", "/../src/test/data/out-large.csv", mode.first, mode.second);
+    REQUIRE( csv.process() == ExitCode::E_SUCCESS );
+    runs.push_back(csv.getRuns());
+
+    // A run is counted once regardless of the chunks and the threads
+    CHECK( runs.back().count() > 0 );
+    CHECK( runs.back().counts[4] == runs.back().count() );
+    CHECK( runs.back().rows == runs.back().count() * 40000ull );
+
+    ifstream in(utility::constructPath("/../src/test/data/out-large.csv"), ios::binary);
+    outputs.push_back(string(istreambuf_iterator<char>(in), istreambuf_iterator<char>()));
+  }
+
+  for (size_t i = 1; i < outputs.size(); ++i)
+  {
+    CHECK( outputs[i] == outputs[0] );
+    CHECK( runs[i].counts == runs[0].counts );
+    CHECK( runs[i].rows == runs[0].rows );
+  }
+
+  remove(utility::constructPath("/../src/test/data/out-large.csv").c_str());
+  remove(utility::constructPath("/../src/test/data/out-large-reject.csv").c_str());
+  remove(utility::constructPath("/../src/test/data/data-large.csv").c_str());
 }
@@ -1,34 +1,58 @@
 #include <array>
+#include <thread>
+#include <vector>
 #include <tuple>
 #include <sstream>
+#include <fstream>
+#include <random>
+#include <regex>
+#include <cstring>
+#if CSV_ZLIB
+#include <zlib.h>
+#endif
 #include "catch.hpp"
 #include "../CsvRowReader.h"
+#include "../BlockClassifier.h"
+#include "../RingBuffer.h"
+#include "../RowBatch.h"
+#include "../io/InputSource.h"
+#include "../io/DecompressingInputSource.h"
+#include "../io/OutputWriter.h"
+#include "../io/RejectWriter.h"
+#include "../io/Checkpoint.h"
+#include "../io/DictionarySnapshot.h"
+#include "../FlatStringMap.h"
+#include "../StringArena.h"
+#include "../CsvFile.h"
+#include "../handlers/CsvProcessorGoogle.h"
+#include "../handlers/CsvScannerGoogle.h"
 #include "../config/BuildConfig.h"
 #include "../config/RuntimeConfig.h"
+#include "../utility.h"
 
 using namespace std;
 
 TEST_CASE( "Test row reader", "[unit]" )
 {
-  wstring csvFields[] = {
-    L"123",                  // non-quoted field
-    L"abc (xyz)",            // non-quoted field
-    L"",                     // empty field
-    L"\"abc xyz\"",          // quoted field without comma
-    L"\"abc, xyz\"",         // quoted field with comma
-    L"\"abc \"\" xyz\"",     // quoted field with escaped quote
-    L"  leading space",
-    L"trailing space   "
+  string csvFields[] = {
+    "123",                   // non-quoted field
+    "abc (xyz)",             // non-quoted field
+    "",                      // empty field
+    "\"abc xyz\"",           // quoted field without comma
+    "\"abc, xyz\"",          // quoted field with comma
+    "\"abc \"\" xyz\"",      // quoted field with escaped quote
+    "  leading space",
+    "trailing space   "
   };
 
-  wstringstream stream;
+  stringstream stream;
 
   for (const auto& field: csvFields)
   {
-    stream << field << L',';
+    stream << field << ',';
   }
 
-  stream << L"end";
+  stream << "end";
 
   auto fun = [&stream] {
     constexpr unsigned DataFieldCount = CsvFieldCounts::s_inputGoogle;
@@ -36,7 +60,8 @@ TEST_CASE( "Test row reader", "[unit]" )
     CsvRowReader<DataFieldCount> reader(arr);
 
     stream >> reader;
-    return make_tuple(reader[1],reader[3],reader[4],reader[5],reader[6]);
+    // The fields are views into the row owned by the reader
+    return make_tuple(string(reader[1]),string(reader[3]),string(reader[4]),string(reader[5]),string(reader[6]));
   };
 
   const auto& [f1,f2,f3,f4,_] = fun();
@@ -47,6 +72,148 @@ TEST_CASE( "Test row reader", "[unit]" )
   CHECK( f4 == csvFields[5] );
 }
 
+TEST_CASE( "Test row reader quoting", "[unit]" )
+{
+  constexpr unsigned DataFieldCount = CsvFieldCounts::s_inputGoogle;
+  array<unsigned, DataFieldCount> arr{0,1,2,3,4};
+  CsvRowReader<DataFieldCount> reader(arr);
+  using csv_error = CsvRowReader<DataFieldCount>::csv_error;
+
+  auto read = [&reader](const string& row) {
+    istringstream stream(row);
+    stream >> reader;
+  };
+
+  read("\"a \"\"b\"\" c\", \"\",x,\"\"\"\"\"\",\"y\"");
+  CHECK( reader[0] == "\"a \"\"b\"\" c\"" );
+  CHECK( reader[1] == "\"\"" );
+  CHECK( reader[2] == "x" );
+  CHECK( reader[3] == "\"\"\"\"\"\"" );
+  CHECK( reader[4] == "\"y\"" );
+
+  read("a,b\"c,,d");
+  CHECK( reader[1] == "b\"c" );
+  CHECK( reader[2].empty() );
+
+  CHECK_THROWS_AS( read("\"abc\"x,y"), csv_error );
+  CHECK_THROWS_AS( read("\"abc\" ,y"), csv_error );
+  CHECK_THROWS_AS( read("x,\"abc"), csv_error );
+  CHECK_THROWS_AS( read("x,\"abc\"\""), csv_error );
+  CHECK_THROWS_AS( read("\"a\"\"b\"\"c\"\"d\""), csv_error );
+  // Fields past the last requested one are not examined
+  CHECK_NOTHROW( read("a,b,c,d,e,\"f") );
+
+  // The rows read from an input source report the errors as return codes
+  using Reader = CsvRowReader<DataFieldCount>;
+  MemoryInputSource source("a,b\n\"abc\"x,y\nx,\"abc\n\"a\"\"b\"\"c\"\"d\"\nc,d");
+  const array<Reader::E_ROW_ERROR, 3> errors{
+    Reader::E_DATA_AFTER_QUOTE, Reader::E_MISSING_QUOTE, Reader::E_ESCAPED_QUOTES };
+
+  auto row = reader.readRow(source);
+  REQUIRE( row );
+  CHECK( *row == "a,b" );
+  CHECK( reader[1] == "b" );
+
+  for (const auto error : errors)
+  {
+    row = reader.readRow(source);
+    REQUIRE_FALSE( row );
+    CHECK( row.error() == error );
+  }
+
+  CHECK( reader.getRow() == "\"a\"\"b\"\"c\"\"d\"" );
+
+  row = reader.readRow(source);
+  REQUIRE( row );
+  CHECK( reader[0] == "c" );
+
+  row = reader.readRow(source);
+  REQUIRE_FALSE( row );
+  CHECK( row.error() == Reader::E_END_OF_INPUT );
+  CHECK( reader[0].empty() );
+}
+
+TEST_CASE( "Test row batches", "[unit]" )
+{
+  batch::Column column{};
+  batch::Values values{};
+  column[1] = 5;
+  values[0] = -1;
+  values[2] = 7;
+  values[63] = 9;
+
+  CHECK( batch::isZero(column) == ~batch::Mask(2) );
+  CHECK( batch::isEqual(values, 7) == 4 );
+  CHECK( batch::isInRange(values, 0, 8) == ~(batch::Mask(1) | (batch::Mask(1) << 63)) );
+  CHECK( batch::firstRows(3) == 7 );
+  CHECK( batch::firstRows(64) == ~batch::Mask(0) );
+
+  // Rows combining the geoindexes, the dates and the metrics the scanner
+  // decides on, some of them incorrectly quoted
+  const string indices[] = { "AU", "AU_NSW", "GB_UKC", "US_CA_06037", "US_CA", "aa", "" };
+  const string dates[] = { utility::getGmtDate(), "2020-02-29", "2019-02-29", "2030-01-01", "1-1-2020" };
+  const string metrics[] = { ",,,,,,,", ",,,,,1,,", ",,,,,,,2", ",\"x,,,,,,", ",,,,,1,2,3" };
+  string data;
+  unsigned rowCount = 0;
+
+  for (const auto& index : indices)
+  {
+    for (const auto& date : dates)
+    {
+      for (const auto& metric : metrics)
+      {
+        data += date + "," + index + metric + "\n";
+        ++rowCount;
+      }
+    }
+  }
+
+  constexpr unsigned DataFieldCount = CsvFieldCounts::s_inputGoogle;
+  CsvRowReader<DataFieldCount> reader({0,1,6,7,8});
+  RowBatch<DataFieldCount> rows;
+  MemoryInputSource source(data);
+  CsvScannerGoogle batchScanner(8);
+  CsvScannerGoogle rowScanner(8);
+  unsigned count = 0;
+  unsigned accepted = 0;
+
+  // Scanning a batch makes the same decisions as scanning the rows one by one
+  while (reader.readBatch(source, rows) > 0)
+  {
+    const auto result = batchScanner.scanBatch(rows);
+
+    CHECK( (result.accept | result.filter | result.reject) == rows.validRows() );
+    CHECK( (result.accept & result.filter) == 0 );
+    CHECK( ((result.accept | result.filter) & result.reject) == 0 );
+
+    for (size_t i = 0; i < rows.size(); ++i, ++count)
+    {
+      const batch::Mask bit = batch::Mask(1) << i;
+      INFO( rows.getRow(i) );
+
+      if ((rows.validRows() & bit) == 0)
+      {
+        CHECK( rows.getRow(i).find("\"x") != string_view::npos );
+        continue;
+      }
+
+      auto field = [&rows, i](unsigned index) { return rows.field(index, i); };
+      const auto expected = rowScanner.scanRow(field);
+
+      CHECK( bool(result.accept & bit) == (expected == CsvScanner::E_ACCEPT) );
+      CHECK( bool(result.filter & bit) == (expected == CsvScanner::E_FILTER) );
+      CHECK( bool(result.reject & bit) == (expected == CsvScanner::E_REJECT) );
+      accepted += expected == CsvScanner::E_ACCEPT;
+    }
+  }
+
+  CHECK( count == rowCount );
+  CHECK( accepted > 0 );
+  CHECK( batchScanner.getRejectedCount() == rowScanner.getRejectedCount() );
+  CHECK( batchScanner.filteredCount() == rowScanner.filteredCount() );
+  CHECK_THROWS_AS( rows.field(2, 0), invalid_argument );
+}
+
 TEST_CASE( "Test run-time configuration", "[unit]" )
 {
   const auto& cfg = RuntimeConfig::GetInstance();
@@ -56,4 +223,798 @@ TEST_CASE( "Test run-time configuration", "[unit]" )
   CHECK( cfg.getRejectedDataRowsThreshold() == 0 );
   CHECK( cfg.getFilterUkNuts() );
   CHECK( cfg.getFilterAuData() );
+  CHECK( cfg.getProcessingThreads() == 2 );
+  CHECK( cfg.getPipelineProcessing() );
+  CHECK( cfg.getOutputCompression().empty() );
+  CHECK( cfg.getCompressionThreads() == 0 );
+}
+
+TEST_CASE( "Test input source", "[unit]" )
+{
+  const string path = utility::constructPath("/../src/test/data/index-valid.csv");
+  auto mapped = InputSource::create(path, true);
+  auto buffered = InputSource::create(path, false);
+
+  REQUIRE( mapped->is_open() );
+  REQUIRE( buffered->is_open() );
+
+  unsigned count = 0;
+  string_view line1, line2;
+
+  while (mapped->getLine(line1))
+  {
+    REQUIRE( buffered->getLine(line2) );
+    CHECK( line1 == line2 );
+    CHECK( line1.find('\n') == string_view::npos );
+    ++count;
+  }
+
+  CHECK_FALSE( buffered->getLine(line2) );
+  CHECK( count == 6 );
+  CHECK_FALSE( *mapped );
+  CHECK_FALSE( mapped->bad() );
+
+  // Blocks of whole lines
+  for (bool bMapped : { true, false })
+  {
+    auto source = InputSource::create(path, bMapped);
+    auto lines = InputSource::create(path, true);
+    string_view block, line;
+    unsigned blocks = 0;
+    bool bTerminated = true;
+
+    while (source->getBlock(100, block))
+    {
+      // Only the last block may lack the terminating '\n'
+      CHECK( bTerminated );
+      bTerminated = block.back() == '\n';
+      ++blocks;
+
+      MemoryInputSource blockSource(block);
+
+      while (blockSource.getLine(line))
+      {
+        REQUIRE( lines->getLine(line1) );
+        CHECK( line == line1 );
+      }
+    }
+
+    CHECK( blocks > 1 );
+    CHECK_FALSE( lines->getLine(line1) );
+    CHECK( source->is_stable() == bMapped );
+  }
+}
+
+#if CSV_ZLIB
+TEST_CASE( "Test compressed input source", "[unit]" )
+{
+  // Exceeds the size of the blocks handed over by the decompressing thread
+  string expected;
+
+  for (unsigned i = 0; expected.size() < (3 << 20); ++i)
+  {
+    expected += "row " + to_string(i) + ",\"a,b\",c\n";
+  }
+
+  // Two concatenated gzip members
+  string compressed;
+
+  for (string_view member : { string_view(expected).substr(0, 1000), string_view(expected).substr(1000) })
+  {
+    z_stream stream = {};
+    REQUIRE( deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK );
+    string buffer(deflateBound(&stream, member.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(member.data()));
+    stream.avail_in = member.size();
+    stream.next_out = reinterpret_cast<Bytef*>(buffer.data());
+    stream.avail_out = buffer.size();
+    REQUIRE( deflate(&stream, Z_FINISH) == Z_STREAM_END );
+    compressed.append(buffer.data(), stream.total_out);
+    deflateEnd(&stream);
+  }
+
+  // The compressed file is found by the extension appended to the path
+  const string path = utility::constructPath("/../src/test/data/out-compressed.csv");
+  ofstream(path + ".gz", ios::binary | ios::trunc) << compressed;
+  CHECK( DecompressingInputSource::getCompression(path + ".gz") == Compression::E_GZIP );
+  CHECK( DecompressingInputSource::getCompression(utility::constructPath("/../src/test/data/index-valid.csv")) ==
+    Compression::E_NONE );
+
+  for (bool bLines : { true, false })
+  {
+    auto source = InputSource::create(path, true);
+    REQUIRE( source->is_open() );
+
+    string content;
+    string_view data;
+
+    while (bLines ? source->getLine(data) : source->getBlock(100000, data))
+    {
+      content += data;
+      content += bLines ? "\n" : "";
+    }
+
+    CHECK_FALSE( source->bad() );
+    CHECK( content == expected );
+  }
+
+  // Truncated data is reported as a read error
+  ofstream(path + ".gz", ios::binary | ios::trunc) << compressed.substr(0, compressed.size() - 100);
+  auto source = InputSource::create(path, false);
+  string_view line;
+
+  while (source->getLine(line));
+
+  CHECK( source->bad() );
+
+  // Destroying the source before reading all the data stops the thread
+  ofstream(path + ".gz", ios::binary | ios::trunc) << compressed;
+  source = InputSource::create(path, false);
+  CHECK( source->getLine(line) );
+  source.reset();
+}
+#endif
+
+TEST_CASE( "Test hasher and checkpoint", "[unit]" )
+{
+  const string data = "2020-01-01,AU,1,2,3\n2020-01-02,AU_NSW,4,5,6\n2020-01-03,GB,7,,9\n";
+  utility::Hasher whole;
+  whole.update(data);
+
+  // The hash does not depend on how the data is split
+  for (size_t i = 0; i <= data.size(); ++i)
+  {
+    for (size_t j = i; j <= data.size(); j += 7)
+    {
+      utility::Hasher hasher;
+      hasher.update(string_view(data).substr(0, i));
+      hasher.update(string_view(data).substr(i, j - i));
+      hasher.update(string_view(data).substr(j));
+      REQUIRE( hasher.value() == whole.value() );
+    }
+  }
+
+  utility::Hasher other;
+  other.update(data.substr(0, data.size() - 1));
+  CHECK( other.value() != whole.value() );
+  other.update("\n\n");
+  CHECK( other.value() != whole.value() );
+
+  const string path = utility::constructPath("/../src/test/data/out-writer.csv");
+  Checkpoint checkpoint;
+  checkpoint.offset = data.size();
+  checkpoint.prefixHash = whole.value();
+  checkpoint.fingerprint = ~uint64_t(0);
+  checkpoint.rows = 3;
+  checkpoint.rejectedRows = 1;
+  REQUIRE( checkpoint.save(path) );
+
+  Checkpoint loaded;
+  REQUIRE( loaded.load(path) );
+  CHECK( loaded.offset == checkpoint.offset );
+  CHECK( loaded.prefixHash == checkpoint.prefixHash );
+  CHECK( loaded.fingerprint == checkpoint.fingerprint );
+  CHECK( loaded.rows == 3 );
+  CHECK( loaded.rejectedRows == 1 );
+  CHECK_FALSE( loaded.load(utility::constructPath("/../src/test/data/index-valid.csv")) );
+}
+
+TEST_CASE( "Test flat string map", "[unit]" )
+{
+  FlatStringMap<unsigned> map;
+  CHECK( map.empty() );
+  CHECK( map.find("") == nullptr );
+
+  for (unsigned i = 0; i < 1000; ++i)
+  {
+    // The key is a temporary, the map keeps a copy
+    const auto outcome = map.emplace("US_" + to_string(i), i);
+    REQUIRE( outcome.second );
+    REQUIRE( *outcome.first == i );
+  }
+
+  const auto outcome = map.emplace("US_7", 1);
+  CHECK_FALSE( outcome.second );
+  CHECK( *outcome.first == 7 );
+  CHECK( map.size() == 1000 );
+
+  for (unsigned i = 0; i < 1000; ++i)
+  {
+    const unsigned* pValue = map.find("US_" + to_string(i));
+    REQUIRE( pValue != nullptr );
+    CHECK( *pValue == i );
+  }
+
+  CHECK( map.find("US_1000") == nullptr );
+  CHECK( map.find("US_") == nullptr );
+
+  // The entries are iterated in the order of insertion
+  unsigned expected = 0;
+
+  for (const auto& entry : map)
+  {
+    CHECK( entry.key == "US_" + to_string(expected) );
+    CHECK( entry.value == expected++ );
+  }
+
+  FlatStringMap<string_view> strings;
+  strings.reserve(10);
+  strings.emplace("", strings.store("empty"));
+  strings.emplace(string(100000, 'x'), strings.store(string(70000, 'y')));
+  REQUIRE( strings.find("") != nullptr );
+  CHECK( *strings.find("") == "empty" );
+  REQUIRE( strings.find(string(100000, 'x')) != nullptr );
+  CHECK( *strings.find(string(100000, 'x')) == string(70000, 'y') );
+}
+
+namespace
+{
+  // Exposes the run statistics of CsvFile
+  struct RunStatsAccess : CsvFile<
+    CsvFieldCounts::s_inputGoogle,
+    CsvFieldCounts::s_indexGoogle,
+    CsvFieldCounts::s_processingGoogle,
+    CsvScannerGoogle,
+    CsvProcessorGoogle<>>
+  {
+    using CsvFile::RunStats;
+  };
+}
+
+TEST_CASE( "Test run statistics", "[unit]" )
+{
+  RunStatsAccess::RunStats runs;
+  CHECK( runs.count() == 0 );
+
+  // The buckets are 1, 2-9, 10-99, 100-999 and 1000 or more rows
+  for (const unsigned length : { 1, 2, 9, 10, 19, 99, 100, 199, 999, 1000, 1999, 100000 })
+  {
+    runs.add(length);
+  }
+
+  CHECK( runs.counts == array<unsigned, 5>{ 1, 2, 3, 3, 3 } );
+  CHECK( runs.count() == 12 );
+  CHECK( runs.rows == 104437 );
+
+  RunStatsAccess::RunStats other;
+  other.add(5);
+  other.add(50);
+  runs.merge(other);
+
+  CHECK( runs.counts == array<unsigned, 5>{ 1, 3, 4, 3, 3 } );
+  CHECK( runs.rows == 104492 );
+}
+
+TEST_CASE( "Test string arena", "[unit]" )
+{
+  StringArena arena;
+  CHECK( arena.store("").empty() );
+  CHECK( arena.concat({ "lookup failed: index \'", "US_CA", "\' not found" }) == "lookup failed: index 'US_CA' not found" );
+
+  // Fills more than one block, including an oversized one
+  vector<string_view> stored;
+  const string big(100000, 'b');
+
+  auto fill = [&arena, &stored, &big]() {
+    stored.clear();
+
+    for (unsigned i = 0; i < 10000; ++i)
+    {
+      stored.push_back(arena.store(i == 5000 ? string_view(big) : "row " + to_string(i)));
+    }
+  };
+
+  arena.reset();
+  fill();
+  const auto pFirst = stored.front().data();
+
+  for (unsigned i = 0; i < stored.size(); ++i)
+  {
+    REQUIRE( stored[i] == (i == 5000 ? big : "row " + to_string(i)) );
+  }
+
+  // The blocks are reused after a reset
+  arena.reset();
+  fill();
+  CHECK( stored.front().data() == pFirst );
+
+  for (unsigned i = 0; i < stored.size(); ++i)
+  {
+    REQUIRE( stored[i] == (i == 5000 ? big : "row " + to_string(i)) );
+  }
+}
+
+TEST_CASE( "Test dictionary snapshot", "[unit]" )
+{
+  const string indexPath = utility::constructPath("/../src/test/data/index-valid.csv");
+  const string path = utility::constructPath("/../src/test/data/out-writer.csv");
+
+  DictionarySnapshot::Key key;
+  REQUIRE( DictionarySnapshot::getKey(indexPath, 1, key) );
+  CHECK( key.size > 0 );
+
+  vector<pair<string_view, DictionarySnapshot::Entry>> entries;
+  vector<string> names;
+
+  for (unsigned i = 0; i < 100; ++i)
+  {
+    names.push_back("AU_" + to_string(i));
+  }
+
+  for (unsigned i = 0; i < names.size(); ++i)
+  {
+    entries.push_back({ names[i], { "AU", i > 0 ? "NSW" : "", i > 50 ? string_view(names[i]) : string_view(), i % 4, names[i] } });
+  }
+
+  RejectBatch rejects;
+  rejects.add(0, 7, "AU_,x");
+  rejects.add(2, 9, "AU_1");
+
+  DictionarySnapshot::Stats stats;
+  stats.rows = 103;
+  stats.rejected = 2;
+  stats.filtered = 1;
+  stats.fingerprint = 42;
+
+  DictionarySnapshot built;
+  built.build(key, entries, stats, rejects);
+  REQUIRE( built.size() == entries.size() );
+  REQUIRE( built.save(path) );
+
+  DictionarySnapshot loaded;
+  REQUIRE( loaded.load(path, key, 3) );
+  REQUIRE( loaded.size() == entries.size() );
+
+  for (const auto& [index, expected] : entries)
+  {
+    DictionarySnapshot::Entry entry;
+    REQUIRE( loaded.find(index, entry) );
+    CHECK( entry.country == expected.country );
+    CHECK( entry.state == expected.state );
+    CHECK( entry.locality == expected.locality );
+    CHECK( entry.level == expected.level );
+    CHECK( entry.fragment == expected.fragment );
+  }
+
+  DictionarySnapshot::Entry entry;
+  CHECK_FALSE( loaded.find("AU_100", entry) );
+  CHECK_FALSE( loaded.find("", entry) );
+
+  CHECK( loaded.getStats().rows == 103 );
+  CHECK( loaded.getStats().rejected == 2 );
+  CHECK( loaded.getStats().filtered == 1 );
+  CHECK( loaded.getStats().fingerprint == 42 );
+
+  RejectBatch restored;
+  loaded.getRejects(restored);
+  vector<string> records;
+  restored.forEach([&records](unsigned reason, size_t row, string_view data) {
+    records.push_back(to_string(reason) + ":" + to_string(row) + ":" + string(data));
+  });
+  CHECK( records == vector<string>{ "0:7:AU_,x", "2:9:AU_1" } );
+
+  // Another key or a damaged file is not loaded
+  DictionarySnapshot::Key other = key;
+  ++other.settings;
+  CHECK_FALSE( loaded.load(path, other, 3) );
+  CHECK_FALSE( loaded.load(indexPath, key, 3) );
+  CHECK_FALSE( loaded.load(path + ".missing", key, 3) );
+
+  {
+    auto source = InputSource::create(path, true);
+    string_view block;
+    REQUIRE( source->getBlock(1 << 20, block) );
+    string data(block);
+    data.resize(data.size() / 2);
+    OutputWriter writer;
+    REQUIRE( writer.open(path) );
+    writer.write(data);
+    writer.close();
+    REQUIRE_FALSE( writer.bad() );
+  }
+
+  CHECK_FALSE( loaded.load(path, key, 3) );
+
+  // A reject reason out of the range of the reasons
+  REQUIRE( built.save(path) );
+  CHECK( loaded.load(path, key, 3) );
+  CHECK_FALSE( loaded.load(path, key, 2) );
+
+  // A bucket table without an empty bucket would make find() loop forever.
+  // The offset of the buckets follows the counts in the header, see
+  // DictionarySnapshot::Header.
+  {
+    auto source = InputSource::create(path, true);
+    string_view block;
+    REQUIRE( source->getBlock(1 << 20, block) );
+    string data(block);
+    const size_t countsOffset = 8 + 8 + sizeof(DictionarySnapshot::Key) + 8;
+    uint32_t bucketCount;
+    uint64_t bucketsOffset;
+    memcpy(&bucketCount, data.data() + countsOffset + 4 * 4, sizeof(bucketCount));
+    memcpy(&bucketsOffset, data.data() + countsOffset + 6 * 4, sizeof(bucketsOffset));
+    REQUIRE( bucketCount > entries.size() );
+    REQUIRE( bucketsOffset + bucketCount * sizeof(uint32_t) <= data.size() );
+
+    for (uint32_t i = 0; i < bucketCount; ++i)
+    {
+      const uint32_t entryNumber = 1;
+      memcpy(&data[bucketsOffset + i * sizeof(uint32_t)], &entryNumber, sizeof(entryNumber));
+    }
+
+    OutputWriter writer;
+    REQUIRE( writer.open(path) );
+    writer.write(data);
+    writer.close();
+    REQUIRE_FALSE( writer.bad() );
+  }
+
+  CHECK_FALSE( loaded.load(path, key, 3) );
+}
+
+TEST_CASE( "Test geoindex validation", "[unit]" )
+{
+  // geoindex, matched, state/province group matched, locality group matched
+  const tuple<string, bool, bool, bool> cases[] = {
+    { "AU", true, false, false },
+    { "AU_NSW", true, true, false },
+    { "AU_NSW_Sydney", true, true, true },
+    { "UA_KBP", true, true, false },
+    { "AB_CDEF", true, false, true },
+    { "AB_cd", true, false, true },
+    { "US_CA_06037", true, true, true },
+    { "PL_14_Łódź", true, true, true },
+    { "JP_13_東京都", true, true, true },
+    { "AA_BB_123456789012", true, true, true },
+    { "AA_BB_1234567890123", false, false, false },
+    { "AA_BB_", false, false, false },
+    { "AA__BB", false, false, false },
+    { "AA_BB_CC_DD", false, false, false },
+    { "A", false, false, false },
+    { "aa", false, false, false },
+    { "", false, false, false },
+    { "AA_BB_C\xFF", false, false, false }
+  };
+
+  for (const auto& [index, matched, state, locality] : cases)
+  {
+    const auto mr = utility::matchIndex(index);
+
+    INFO( index );
+    CHECK( mr.matched == matched );
+    CHECK( mr.state == state );
+    CHECK( mr.locality == locality );
+  }
+
+  // The matchers agree with std::regex on all the short ASCII strings
+  // made of the characters significant for the patterns
+  const regex indexPattern("^[A-Z]{2}(_[A-Z0-9]{1,3})?(_[A-Za-z0-9]{1,12})?$");
+  const regex datePattern("^\\d{4}-\\d{2}-\\d{2}$");
+  const regex nutsPattern("^GB_UK[A-Z]$");
+  const string alphabet = "A1_a";
+  vector<string> strings{ "" };
+
+  for (size_t begin = 0, end = 1; strings.back().size() < 7; begin = end, end = strings.size())
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      for (const char c : alphabet)
+      {
+        strings.push_back(strings[i] + c);
+      }
+    }
+  }
+
+  for (const auto& str : strings)
+  {
+    smatch mr;
+    const bool bMatched = regex_match(str, mr, indexPattern);
+    const auto im = utility::matchIndex(str);
+
+    INFO( str );
+    REQUIRE( im.matched == bMatched );
+    REQUIRE( im.state == (bMatched && mr[1].matched) );
+    REQUIRE( im.locality == (bMatched && mr[2].matched) );
+  }
+
+  // The date is checked against the calendar by a round trip through timegm()
+  auto expectedDate = [&datePattern](const string& str) {
+    struct tm tmDate{};
+
+    if (!regex_match(str, datePattern) ||
+      sscanf(str.c_str(), "%d-%d-%d", &tmDate.tm_year, &tmDate.tm_mon, &tmDate.tm_mday) != 3)
+    {
+      return utility::g_invalidDate;
+    }
+
+    const int year = tmDate.tm_year;
+    const int month = tmDate.tm_mon;
+    const int day = tmDate.tm_mday;
+    tmDate.tm_year -= 1900;
+    tmDate.tm_mon -= 1;
+    const time_t time = timegm(&tmDate);
+
+    if (year < 1970 || tmDate.tm_year != year - 1900 || tmDate.tm_mon != month - 1 || tmDate.tm_mday != day)
+    {
+      return utility::g_invalidDate;
+    }
+
+    return static_cast<int>(time / 86400);
+  };
+
+  mt19937 generator(2020);
+  const string mutations = "01234569-GBUK_";
+
+  for (unsigned i = 0; i < 20000; ++i)
+  {
+    string str = i % 2 ? "2020-02-29" : "GB_UKA";
+
+    // Mutate a random character or two of a valid string
+    for (unsigned j = 0; j <= i % 3; ++j)
+    {
+      str[generator() % str.size()] = mutations[generator() % mutations.size()];
+    }
+
+    INFO( str );
+    REQUIRE( utility::parseDate(str) == expectedDate(str) );
+    REQUIRE( utility::isUkNuts(str) == regex_match(str, nutsPattern) );
+  }
+
+  // Every day of the years the data can refer to
+  for (int day = 0; day < 60 * 366; ++day)
+  {
+    const time_t time = time_t(day) * 86400;
+    struct tm tmDate{};
+    char buf[16];
+    gmtime_r(&time, &tmDate);
+    strftime(buf, sizeof(buf), "%F", &tmDate);
+
+    INFO( buf );
+    REQUIRE( utility::parseDate(buf) == day );
+  }
+
+  CHECK( utility::utf8Length("Łódź") == 4 );
+  CHECK( utility::utf8Length("東京都") == 3 );
+}
+
+TEST_CASE( "Test block classifier", "[unit]" )
+{
+  const char chars[] = { 'a', ',', '"', '\n', ' ', '\xC5', '\x81' };
+  char block[BlockClassifier::s_blockSize];
+  srand(1);
+
+  for (unsigned i = 0; i < 1000; ++i)
+  {
+    for (auto& c : block)
+    {
+      c = chars[rand() % sizeof(chars)];
+    }
+
+    BlockClassifier::BlockMasks expected;
+    BlockClassifier::classify(block, expected, BlockClassifier::E_SCALAR);
+
+    for (auto kernel : { BlockClassifier::E_SSE2, BlockClassifier::E_AVX2 })
+    {
+      if (BlockClassifier::isSupported(kernel))
+      {
+        BlockClassifier::BlockMasks masks;
+        BlockClassifier::classify(block, masks, kernel);
+        REQUIRE( masks.newline == expected.newline );
+        REQUIRE( masks.comma == expected.comma );
+        REQUIRE( masks.quote == expected.quote );
+      }
+    }
+
+    // Find the characters in the unaligned tail of the data
+    const string_view data(block + 1, sizeof(block) - 1);
+    BlockClassifier classifier(data);
+    const size_t pos = rand() % data.size();
+    const size_t comma = data.find(',', pos);
+
+    REQUIRE( classifier.findComma(pos) == (comma == string_view::npos ? data.size() : comma) );
+  }
+
+  // Data spanning several blocks
+  const string data = string(100, 'x') + "\"" + string(100, 'y') + ",";
+  BlockClassifier classifier(data);
+  CHECK( classifier.findQuote(0) == 100 );
+  CHECK( classifier.findComma(0) == 201 );
+  CHECK( classifier.findNewline(0) == data.size() );
+  CHECK( classifier.findComma(202) == data.size() );
+}
+
+TEST_CASE( "Test ring buffers", "[unit]" )
+{
+  SpscRing<unsigned> spsc(3);
+  unsigned item = 0;
+
+  // The capacity is rounded up to a power of two
+  for (unsigned i = 0; i < 4; ++i)
+  {
+    CHECK( spsc.tryPush(i) );
+  }
+
+  CHECK_FALSE( spsc.tryPush(4) );
+
+  for (unsigned i = 0; i < 4; ++i)
+  {
+    CHECK( spsc.tryPop(item) );
+    CHECK( item == i );
+  }
+
+  CHECK_FALSE( spsc.tryPop(item) );
+
+  // Each producer pushes its items in ascending order
+  constexpr unsigned producerCount = 3;
+  constexpr unsigned itemCount = 10000;
+  MpscRing<unsigned> mpsc(8);
+  vector<thread> producers;
+
+  for (unsigned p = 0; p < producerCount; ++p)
+  {
+    producers.emplace_back([&mpsc, p]()
+    {
+      for (unsigned i = 0; i < itemCount; ++i)
+      {
+        mpsc.push(p * itemCount + i);
+      }
+    });
+  }
+
+  vector<unsigned> next(producerCount, 0);
+  bool bOrdered = true;
+
+  for (unsigned i = 0; i < producerCount * itemCount; ++i)
+  {
+    mpsc.pop(item);
+    const unsigned p = item / itemCount;
+    bOrdered = bOrdered && item % itemCount == next[p]++;
+  }
+
+  for (auto& t : producers)
+  {
+    t.join();
+  }
+
+  CHECK( bOrdered );
+  CHECK_FALSE( mpsc.tryPop(item) );
+}
+
+TEST_CASE( "Test output writer", "[unit]" )
+{
+  OutputBuffer buffer;
+
+  buffer.appendField("a");
+  buffer.appendField("");
+  buffer.appendField("\"b,c\"");
+  buffer.endRow();
+  buffer.appendField("x");
+  buffer.appendField("y");
+  buffer.discardRow();
+  buffer.append("row ");
+  buffer.appendNumber(1234567890123ULL);
+  buffer.append('\n');
+  buffer.appendField("z");
+  buffer.endRow();
+
+  const string expected = "a,,\"b,c\"\nrow 1234567890123\nz\n";
+  CHECK( buffer.data() == expected );
+
+  // Small writes are buffered, large ones bypass the buffer
+  const string path = utility::constructPath("/../src/test/data/out-writer.csv");
+  const string large(5 << 20, 'x');
+  {
+    OutputWriter writer;
+    REQUIRE( writer.open(path) );
+    writer.write(buffer.data());
+    writer.write(large);
+    writer.write(buffer.data());
+    writer.close();
+    CHECK_FALSE( writer.bad() );
+  }
+
+  auto source = InputSource::create(path, true);
+  string_view line;
+  string content;
+
+  while (source->getLine(line))
+  {
+    content += line;
+    content += '\n';
+  }
+
+  CHECK( content == expected + large + expected );
+}
+
+TEST_CASE( "Test compressed output writer", "[unit]" )
+{
+  string expected;
+
+  for (unsigned i = 0; expected.size() < (5 << 20); ++i)
+  {
+    expected += "row " + to_string(i) + ",\"a,b\",c\n";
+  }
+
+  const string path = utility::constructPath("/../src/test/data/out-compressed.csv");
+
+  for (auto compression : { Compression::E_GZIP, Compression::E_ZSTD })
+  {
+    if (!Compression::isSupported(compression))
+    {
+      continue;
+    }
+
+    const string compressedPath = path + (compression == Compression::E_GZIP ? ".gz" : ".zst");
+    {
+      // Small writes are buffered, the large one is split into blocks
+      OutputWriter writer;
+      REQUIRE( writer.open(compressedPath, compression, 3) );
+      writer.write(string_view(expected).substr(0, 1000));
+      writer.write(string_view(expected).substr(1000, 4 << 20));
+      writer.flush();
+      writer.write(string_view(expected).substr(1000 + (4 << 20)));
+      writer.close();
+      CHECK_FALSE( writer.bad() );
+    }
+
+    CHECK( DecompressingInputSource::getCompression(compressedPath) == compression );
+
+    auto source = InputSource::create(compressedPath, true);
+    string_view line;
+    string content;
+
+    while (source->getLine(line))
+    {
+      content += line;
+      content += '\n';
+    }
+
+    CHECK_FALSE( source->bad() );
+    CHECK( content == expected );
+  }
+}
+
+TEST_CASE( "Test reject writer", "[unit]" )
+{
+  const string path = utility::constructPath("/../src/test/data/out-writer.csv");
+  {
+    // Write two rejects per reason, then every third one
+    RejectWriter writer({ { "Bad", "Bad: ", false }, { "Row", "Row ", true } }, 2, 3);
+    REQUIRE( writer.open(path) );
+
+    RejectBatch batch;
+
+    for (unsigned i = 0; i < 10; ++i)
+    {
+      batch.add(1, i, "x");
+    }
+
+    writer.add(0, 0, "a");
+    writer.addFields(0, 1, array<string, 2>{ "b", "c" });
+    writer.add(0, 2, "d");
+    writer.submit(batch, 100);
+    CHECK( batch.empty() );
+    writer.close();
+    CHECK_FALSE( writer.bad() );
+  }
+
+  auto source = InputSource::create(path, true);
+  string_view line;
+  string content;
+
+  while (source->getLine(line))
+  {
+    content += line;
+    content += '\n';
+  }
+
+  CHECK( content ==
+    "Bad: a\n"
+    "Bad: b,c\n"
+    "Row 100: x\n"
+    "Row 101: x\n"
+    "Row 104: x\n"
+    "Row 107: x\n"
+    "Bad: omitted 1 more rejected rows\n"
+    "Row: omitted 6 more rejected rows\n" );
 }
@@ -54,13 +54,13 @@ string utility::getConfigFilePath(const string& strExtension)
 }
 
 [[gnu::pure]]
-const wchar_t* utility::getGmtDate()
+const char* utility::getGmtDate()
 {
-  static wstring ret;
+  static string ret;
 
-  auto getGmt = [](wstring& wstr)
+  auto getGmt = [](string& str)
   { 
-    wchar_t buf[256];
+    char buf[256];
     time_t curtime;
     struct tm tmtime;
 
@@ -69,11 +69,43 @@ const wchar_t* utility::getGmtDate()
 
     curtime = ::time (nullptr);
     ::gmtime_r (&curtime, &tmtime);
-    ::wcsftime (buf, sizeof(buf), L"%F", &tmtime);
-    wstr.assign(buf);
+    ::strftime (buf, sizeof(buf), "%F", &tmtime);
+    str.assign(buf);
   };
 
   //getGmt(ret);
   call_once(s_flag1, getGmt, ret);
   return ret.c_str();
 }
+
+size_t utility::utf8Length(string_view str)
+{
+  size_t ret = 0;
+
+  for (const char c : str)
+  {
+    // Count all bytes except continuation bytes
+    ret += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+  }
+
+  return ret;
+}
+
+// The matchers are checked against their patterns at compile time
+static_assert(utility::matchIndex("AU").matched && !utility::matchIndex("AU").state);
+static_assert(utility::matchIndex("AU_NSW").state && !utility::matchIndex("AU_NSW").locality);
+static_assert(utility::matchIndex("AB_CDEF").locality && !utility::matchIndex("AB_CDEF").state);
+static_assert(utility::matchIndex("US_CA_06037").state && utility::matchIndex("US_CA_06037").locality);
+static_assert(utility::matchIndex("PL_14_\xC5\x81\xC3\xB3" "d\xC5\xBA").locality);
+static_assert(!utility::matchIndex("AA_BB_1234567890123").matched);
+static_assert(!utility::matchIndex("AA_BB_C\xFF").matched);
+static_assert(!utility::matchIndex("AA__BB").matched && !utility::matchIndex("aa").matched);
+static_assert(utility::parseDate("1970-01-01") == 0 && utility::parseDate("2020-08-01") == 18475);
+static_assert(utility::parseDate("2000-03-01") == 11017 && utility::parseDate("2020-02-29") == 18321);
+static_assert(utility::parseDate("2021-02-29") == utility::g_invalidDate);
+static_assert(utility::parseDate("2020-13-01") == utility::g_invalidDate);
+static_assert(utility::parseDate("2020-04-31") == utility::g_invalidDate);
+static_assert(utility::parseDate("2020-8-01") == utility::g_invalidDate);
+static_assert(utility::parseDate("1969-12-31") == utility::g_invalidDate);
+static_assert(utility::parseDate("2020/08/01") == utility::g_invalidDate);
+static_assert(utility::isUkNuts("GB_UKC") && !utility::isUkNuts("GB_UKC1") && !utility::isUkNuts("GB_ENG"));
@@ -3,15 +3,21 @@
 */
 #pragma once
 
-#include <regex>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <stdexcept>
 #include <functional>
 #include <string.h>
 
 namespace utility
 {
+  // The action is a template parameter rather than std::function so that
+  // the call is inlined, e.g. when the row count is incremented per row
+  template <typename Action>
   struct ScopedAction
   {
-    ScopedAction(std::function<void()> action) : m_action(action)
+    ScopedAction(Action action) : m_action(action)
     {
     }
     ~ScopedAction()
@@ -20,7 +26,7 @@ namespace utility
     }
 
   private:
-    std::function<void()> m_action;
+    Action m_action;
   };
 
   struct Counter
@@ -31,11 +37,167 @@ namespace utility
     auto getRejectedCount() { return m_countRejected; }
     auto filteredCount() { return m_countFiltered; }
 
+    // Adds the counts of another counter and resets them, so that the counts
+    // collected by several counters are reported once
+    void addCounts(Counter& other)
+    {
+      m_countRejected += other.m_countRejected;
+      m_countFiltered += other.m_countFiltered;
+      other.m_countRejected = other.m_countFiltered = 0;
+    }
+
   protected:
     unsigned m_countRejected;
     unsigned m_countFiltered;
   };
 
+  template <typename E>
+  struct Unexpected
+  {
+    E error;
+  };
+
+  template <typename E>
+  Unexpected<E> unexpected(E error)
+  {
+    return Unexpected<E>{error};
+  }
+
+  // Either a value or an error code, similar to C++23 std::expected. Used by
+  // the per-row operations whose failures are expected to be frequent, so
+  // that a failed row costs a branch rather than unwinding the stack.
+  template <typename T, typename E>
+  class Expected
+  {
+  public:
+    Expected() : m_value(), m_error(), m_bValue(true)
+    {
+    }
+
+    Expected(const T& value) : m_value(value), m_error(), m_bValue(true)
+    {
+    }
+
+    Expected(Unexpected<E> error) : m_value(), m_error(error.error), m_bValue(false)
+    {
+    }
+
+    bool has_value() const { return m_bValue; }
+    explicit operator bool() const { return m_bValue; }
+    const T& value() const { return m_value; }
+    const T& operator*() const { return m_value; }
+    const T* operator->() const { return &m_value; }
+    E error() const { return m_error; }
+
+  private:
+    T m_value;
+    E m_error;
+    bool m_bValue;
+  };
+
+  // Non-cryptographic 64-bit hash of a stream of data. The data is hashed
+  // eight bytes at a time, the value does not depend on how the stream is
+  // split into pieces so that the hash of a file prefix can be extended.
+  class Hasher
+  {
+  public:
+    Hasher() : m_state(s_seed), m_length(0), m_pending(0) {}
+
+    void update(std::string_view data)
+    {
+      unsigned pending = m_length % 8;
+      m_length += data.size();
+
+      // Complete the pending word
+      for (; pending != 0 && !data.empty(); data.remove_prefix(1))
+      {
+        m_pending |= std::uint64_t(static_cast<unsigned char>(data.front())) << (pending * 8);
+
+        if (++pending == 8)
+        {
+          m_state = mix(m_state, m_pending);
+          m_pending = 0;
+          pending = 0;
+        }
+      }
+
+      // The words are little-endian, as the pending word
+      for (; data.size() >= 8; data.remove_prefix(8))
+      {
+        std::uint64_t word;
+        ::memcpy(&word, data.data(), sizeof(word));
+        m_state = mix(m_state, word);
+      }
+
+      for (unsigned shift = 0; !data.empty(); shift += 8, data.remove_prefix(1))
+      {
+        m_pending |= std::uint64_t(static_cast<unsigned char>(data.front())) << shift;
+      }
+    }
+
+    void update(std::uint64_t value)
+    {
+      char buf[sizeof(value)];
+      ::memcpy(buf, &value, sizeof(value));
+      update(std::string_view(buf, sizeof(buf)));
+    }
+
+    std::uint64_t value() const
+    {
+      std::uint64_t ret = mix(m_state, m_pending) ^ m_length;
+      // Final avalanche, see MurmurHash3
+      ret ^= ret >> 33;
+      ret *= 0xFF51AFD7ED558CCDULL;
+      ret ^= ret >> 33;
+      ret *= 0xC4CEB9FE1A85EC53ULL;
+      ret ^= ret >> 33;
+      return ret;
+    }
+
+  private:
+    static std::uint64_t mix(std::uint64_t state, std::uint64_t word)
+    {
+      state ^= word * 0x9E3779B97F4A7C15ULL;
+      return ((state << 27) | (state >> 37)) * 0x87C37B91114253D5ULL;
+    }
+
+    std::uint64_t m_state;
+    std::uint64_t m_length;
+    // Bytes of the incomplete word, little-endian
+    std::uint64_t m_pending;
+
+    static const std::uint64_t s_seed = 0x243F6A8885A308D3ULL;
+  };
+
+  // Hash of a short string such as a geoindex, cheaper than Hasher for a
+  // single piece of data. Not compatible with Hasher.
+  inline std::uint64_t hashKey(std::string_view key)
+  {
+    std::uint64_t ret = 0x9E3779B97F4A7C15ULL ^ key.size();
+    const char* p = key.data();
+    std::size_t len = key.size();
+
+    for (; len >= 8; p += 8, len -= 8)
+    {
+      std::uint64_t word;
+      ::memcpy(&word, p, sizeof(word));
+      ret = (ret ^ word) * 0x87C37B91114253D5ULL;
+      ret ^= ret >> 29;
+    }
+
+    if (len > 0)
+    {
+      std::uint64_t word = 0;
+      ::memcpy(&word, p, len);
+      ret = (ret ^ word) * 0x87C37B91114253D5ULL;
+    }
+
+    ret ^= ret >> 33;
+    ret *= 0xFF51AFD7ED558CCDULL;
+    ret ^= ret >> 33;
+    return ret;
+  }
+
   template <typename T>
   [[noreturn]] void throw_exception(const char* msg)
   {
@@ -47,7 +209,214 @@ namespace utility
 
   std::string constructPath(const std::string& strPath);
   std::string getConfigFilePath(const std::string& strExtension = ".cfg");
-  const wchar_t* getGmtDate();
+  const char* getGmtDate();
+  // Count of UTF-8 encoded characters (as opposed to bytes)
+  std::size_t utf8Length(std::string_view str);
+
+  // The data is validated against fixed patterns by the matchers below.
+  // The matchers are hand-compiled deterministic automata: each byte is
+  // examined once, without backtracking, and the matchers are constexpr so
+  // that they can be checked against their patterns at compile time (see
+  // utility.cpp) and against std::regex by the tests and the benchmarks.
+
+  // Outcome of geoindex validation. The geoindex is matched byte by byte
+  // against the pattern ^[A-Z]{2}(_[A-Z0-9]{1,3})?(_[A-Za-z0-9\u0080-\uDB7F]{1,12})?$
+  // and the flags tell which optional group (if any) has matched, the same
+  // way as mr[1].matched and mr[2].matched do for std::regex_match.
+  struct IndexMatch
+  {
+    bool matched = false;
+    bool state = false;       // first group: state/province code
+    bool locality = false;    // second group: locality code
+  };
+
+  namespace detail
+  {
+    constexpr bool isUpper(unsigned char c) { return c >= 'A' && c <= 'Z'; }
+    constexpr bool isDigit(unsigned char c) { return c >= '0' && c <= '9'; }
+    constexpr bool isContinuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+    // Returns the length in bytes of the character at pos if it belongs to
+    // the class [A-Za-z0-9\u0080-\uDB7F] or zero otherwise
+    constexpr std::size_t locality_char(std::string_view str, std::size_t pos)
+    {
+      const unsigned char c = static_cast<unsigned char>(str[pos]);
+      const std::size_t avail = str.size() - pos;
+
+      if (isUpper(c) || isDigit(c) || (c >= 'a' && c <= 'z'))
+      {
+        return 1;
+      }
+
+      // U+0080 - U+07FF
+      if (c >= 0xC2 && c <= 0xDF)
+      {
+        return avail >= 2 && isContinuation(static_cast<unsigned char>(str[pos + 1])) ? 2 : 0;
+      }
+
+      // U+0800 - U+D7FF, surrogates cannot be encoded in valid UTF-8
+      if (c >= 0xE0 && c <= 0xED && avail >= 3)
+      {
+        const unsigned char c1 = static_cast<unsigned char>(str[pos + 1]);
+        const unsigned char c2 = static_cast<unsigned char>(str[pos + 2]);
+
+        if (isContinuation(c1) && isContinuation(c2))
+        {
+          const bool bOverlong = c == 0xE0 && c1 < 0xA0;
+          const bool bSurrogate = c == 0xED && c1 >= 0xA0;
+          return bOverlong || bSurrogate ? 0 : 3;
+        }
+      }
+
+      return 0;
+    }
+
+    // Matches (_[A-Za-z0-9\u0080-\uDB7F]{1,12})?$ at the given position
+    constexpr bool match_locality(std::string_view index, std::size_t pos, bool& bMatched)
+    {
+      bMatched = false;
+
+      if (pos == index.size())
+      {
+        return true;
+      }
+
+      if (index[pos] != '_')
+      {
+        return false;
+      }
+
+      unsigned count = 0;
+
+      for (++pos; pos < index.size(); ++count)
+      {
+        const std::size_t len = locality_char(index, pos);
+
+        if (len == 0)
+        {
+          return false;
+        }
+
+        pos += len;
+      }
+
+      bMatched = count >= 1 && count <= 12;
+      return bMatched;
+    }
+  }
+
+  constexpr IndexMatch matchIndex(std::string_view index)
+  {
+    using namespace detail;
+    IndexMatch ret;
+
+    if (index.size() < 2 || !isUpper(index[0]) || !isUpper(index[1]))
+    {
+      return ret;
+    }
+
+    // The state/province group (_[A-Z0-9]{1,3})? is tried first. It can only
+    // be followed by the locality group or the end of the geoindex, neither of
+    // which starts with [A-Z0-9], so the group is taken if the whole run of
+    // [A-Z0-9] after the underscore fits into it.
+    if (index.size() > 2 && index[2] == '_')
+    {
+      std::size_t pos = 3;
+
+      while (pos < index.size() && (isUpper(index[pos]) || isDigit(index[pos])))
+      {
+        ++pos;
+      }
+
+      if (pos > 3 && pos <= 6 && match_locality(index, pos, ret.locality))
+      {
+        ret.matched = ret.state = true;
+        return ret;
+      }
+    }
 
-  const inline std::wregex g_regexIndex{L"^[A-Z]{2}(_[A-Z0-9]{1,3})?(_[A-Za-z0-9\\u0080-\\uDB7F]{1,12})?$"};
+    ret.matched = match_locality(index, 2, ret.locality);
+    return ret;
+  }
+
+  namespace detail
+  {
+    // True if the bytes of the word selected by the mask are ASCII digits.
+    // A byte is a digit if its high nibble is 3 before and after adding 6.
+    constexpr bool allDigits(std::uint64_t word, std::uint64_t mask)
+    {
+      const std::uint64_t high = 0xF0F0F0F0F0F0F0F0ULL & mask;
+      const std::uint64_t threes = 0x3030303030303030ULL & mask;
+      return (word & high) == threes && ((word + 0x0606060606060606ULL) & high) == threes;
+    }
+  }
+
+  // Returned by parseDate() if the string is not a valid date
+  constexpr int g_invalidDate = -1;
+
+  // Parses a date in the YYYY-MM-DD format into the count of days since
+  // 1970-01-01, so that the dates are compared and filtered as integers.
+  // Unlike the pattern ^\d{4}-\d{2}-\d{2}$ the month and the day are checked
+  // against the calendar. Returns g_invalidDate if the date is malformed,
+  // does not exist or precedes 1970. The first eight bytes are validated
+  // and converted as a single word (SWAR) rather than byte by byte.
+  constexpr int parseDate(std::string_view date)
+  {
+    if (date.size() != 10)
+    {
+      return g_invalidDate;
+    }
+
+    // "YYYY-MM-" as a little-endian word, the compilers turn the loop into
+    // a single load
+    std::uint64_t word = 0;
+
+    for (unsigned i = 0; i < 8; ++i)
+    {
+      word |= std::uint64_t(static_cast<unsigned char>(date[i])) << (i * 8);
+    }
+
+    const std::uint64_t digitMask = 0x00FFFF00FFFFFFFFULL;
+    const std::uint64_t dashes = 0x2D00002D00000000ULL;
+    const unsigned dayDigits = static_cast<unsigned char>(date[8]) | static_cast<unsigned char>(date[9]) << 8;
+
+    if ((word & ~digitMask) != dashes || !detail::allDigits(word, digitMask) ||
+        !detail::allDigits(dayDigits, 0xFFFF))
+    {
+      return g_invalidDate;
+    }
+
+    // The digit values, the dashes are replaced with zeros. Each byte then
+    // becomes the two-digit number starting at the byte.
+    std::uint64_t digits = (word & digitMask) - (0x3030303030303030ULL & digitMask);
+    digits = digits * 10 + (digits >> 8);
+
+    const unsigned year = (digits & 0xFF) * 100 + ((digits >> 16) & 0xFF);
+    const unsigned month = (digits >> 40) & 0xFF;
+    const unsigned day = ((dayDigits & 0xFF) - '0') * 10 + ((dayDigits >> 8) - '0');
+
+    const bool bLeap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    // 31 days in the odd months up to July and in the even ones after it
+    const unsigned monthDays = month == 2 ? 28 + bLeap : 30 + ((month + (month >> 3)) & 1);
+
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > monthDays)
+    {
+      return g_invalidDate;
+    }
+
+    // See Howard Hinnant's days_from_civil, the years start in March
+    const unsigned y = year - (month <= 2);
+    const unsigned era = y / 400;
+    const unsigned yoe = y - era * 400;
+    const unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return static_cast<int>(era * 146097 + doe) - 719468;
+  }
+
+  // Finds UK NUTS regions matching the pattern ^GB_UK[A-Z]$
+  constexpr bool isUkNuts(std::string_view index)
+  {
+    return index.size() == 6 && index[0] == 'G' && index[1] == 'B' && index[2] == '_' &&
+      index[3] == 'U' && index[4] == 'K' && detail::isUpper(index[5]);
+  }
 } // namespace utility